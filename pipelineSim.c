@@ -1,8 +1,20 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
-
-#define NUMMEMORY 16 /* Maximum number of data words in memory */
+#include <stdarg.h>
+#include <ctype.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#define NUMMEMORY 16 /* Minimum number of data words in memory (and number printed) */
 #define NUMREGS 8    /* Number of registers */
 
 /* Opcode values for instructions */
@@ -16,19 +28,244 @@
 #define ADD 32
 #define SUB 34
 
+/* Decoded operations. OP_NOOP is 0 so that zeroed memory decodes to NOOPs. */
+#define OP_NOOP 0
+#define OP_ADD 1
+#define OP_SUB 2
+#define OP_LW 3
+#define OP_SW 4
+#define OP_BNE 5
+#define OP_HALT 6
+
+#define NUMOPS 7
+
+#define ISRTYPE(op) ((op) <= OP_SUB)  /* NOOP, ADD and SUB share the R-type format */
+
+/* Decoded instructions are stored one slot after their word in instrMem, */
+/* so that index 0 (the value of a zeroed pipeline register) is a NOOP.   */
+/* The slot after the last word holds a HALT, fetched for any PC outside  */
+/* instruction memory, so that the pipeline stops running off the end    */
+/* just as the functional engine does.                                    */
+#define NOOPINDEX 0
+#define DECODEDINDEX(pc) ((pc) / 4 + 1)
+#define DECODEDPC(index) (((index) - 1) * 4)
+#define ENDINDEX(statePtr) DECODEDINDEX(4 * (statePtr)->numInstrMem)
+
+/* Operations of translated basic blocks, see translateBlock */
+#define XOP_ADD 0
+#define XOP_SUB 1
+#define XOP_LW 2
+#define XOP_SW 3
+#define XOP_BNE 4        /* Ends a block: go on with the taken or the fall-through block */
+#define XOP_NEXT 5       /* Ends a block cut at BLOCKMAX: go on with the next block */
+#define XOP_EXIT 6       /* Ends a block at a HALT or the end of instruction memory */
+#define BLOCKMAX 64      /* Most instructions in a translated block */
+
 /* Branch Prediction Buffer Values */
 #define STRONGLYTAKEN 3
 #define WEAKLYTAKEN 2
 #define WEAKLYNOTTAKEN 1
 #define STRONGLYNOTTAKEN 0
 
-typedef struct IFIDStruct {
+/* Checkpoint file format */
+#define CKPTMAGIC "PSIMCKPT"
+#define CKPTVERSION 8
+#define CKPTALIGN 65536  /* Alignment of the memory images, a multiple of any page size */
+#define IMAGEMAGIC "PSIMPROG"
+#define IMAGEVERSION 1
+
+/* Branch predictor types */
+#define BP_NOTTAKEN 0    /* Static not-taken */
+#define BP_BIMODAL 1     /* 2-bit counters indexed by PC */
+#define BP_GSHARE 2      /* 2-bit counters indexed by PC xor global history */
+#define BP_TOURNAMENT 3  /* Bimodal and gshare with a per-PC chooser */
+
+#define BPENTRIES 1024   /* Default number of entries in each counter table */
+#define BTBENTRIES 256   /* Default number of branch target buffer entries */
+
+/* Cache levels */
+#define CACHE_L1I 0      /* Level 1 instruction cache */
+#define CACHE_L1D 1      /* Level 1 data cache */
+#define CACHE_L2 2       /* Level 2 cache, shared by the level 1 caches */
+#define NUMCACHES 3
+
+/* Set in the addresses the instruction cache passes on, so that */
+/* instructions and data do not alias in the shared L2           */
+#define INSTRSPACE 0x80000000u
+
+/* Cache replacement policies */
+#define REPL_LRU 0
+#define REPL_FIFO 1
+#define REPL_RANDOM 2
+
+#define MAXWIDTH 4       /* Widest issue width; slot 0 is the only one used at width 1 */
+
+/* Default sizes of the out-of-order back end */
+#define ROBSIZE 32       /* Reorder buffer entries */
+#define IQSIZE 16        /* Issue queue entries */
+#define LSQSIZE 16       /* Load/store queue entries */
+#define PHYSREGS 32      /* Rename registers, in addition to regFile */
+
+/* States of a reorder buffer entry */
+#define ROB_WAITING 0    /* In the issue queue, waiting for its operands */
+#define ROB_EXECUTING 1  /* Issued, result not available yet */
+#define ROB_DONE 2       /* Ready to commit */
+
+#define MEMLATENCY 50    /* Default main memory latency in cycles */
+
+/* Benchmark kernels */
+#define KERNEL_SUM 0     /* Sum an array: lw and add */
+#define KERNEL_COPY 1    /* Copy an array: lw and sw */
+#define KERNEL_CHASE 2   /* Follow a randomly ordered linked list: dependent loads */
+#define KERNEL_LOOP 3    /* Nested countdown loops: bne */
+#define KERNEL_CHAIN 4   /* Chains of dependent adds: forwarding */
+#define NUMKERNELS 5
+#define KERNELMAX (1 << 24)  /* Largest kernel size, so that every address fits */
+#define BENCHREPS 3      /* Runs of each kernel; the fastest is reported */
+
+#define CHECKBATCH 1024  /* Retired instructions buffered before they are checked */
+
+#define MAXCORES 64      /* Most simulated cores */
+#define QUANTUM 1000     /* Default cycles the cores run between synchronizations */
+#define COREREG (NUMREGS - 1)  /* Register that holds the core number when a core starts */
+
+/* Loads and stores of the pipeline models to data memory. Cores on       */
+/* different host threads share it, so they are relaxed atomic accesses, */
+/* which compile to plain loads and stores on common hosts.               */
+#ifdef __GNUC__
+#define LOADDATA(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#define STOREDATA(p, v) __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#else
+#define LOADDATA(p) atomic_load_explicit((_Atomic int *)(p), memory_order_relaxed)
+#define STOREDATA(p, v) atomic_store_explicit((_Atomic int *)(p), (v), memory_order_relaxed)
+#endif
+
+/* Timeline trace file format */
+#define TIMELINEMAGIC "PSIMTIME"
+#define TIMELINEVERSION 1
+#define TIMELINEBUFFER 8192  /* Events buffered between writes */
+
+/* Timeline event kinds. Events are written in cycle order; see eventType.  */
+/* EV_INSTR, EV_FETCH and EV_FORWARD are followed by an EV_VALUE record.    */
+#define EV_INSTR 0       /* Static instruction: id is its address, the value its encoding */
+#define EV_FETCH 1       /* Instruction id is fetched from the address in the value */
+#define EV_STAGE 2       /* Instruction id enters stage arg (STAGE_ value) */
+#define EV_STALL 3       /* Instruction id is held for reason arg (STALL_ value); id 0 if none is fetched */
+#define EV_FORWARD 4     /* Instruction id gets an operand over path arg (FWD_ value) from the value's */
+#define EV_BRANCH 5      /* Branch id resolves; arg bit 0 is set if taken, bit 1 if mispredicted */
+#define EV_RETIRE 6      /* Instruction id retires */
+#define EV_FLUSH 7       /* Instruction id is squashed */
+#define EV_SKIP 8        /* id cycles pass in addition to the next event's delta */
+#define EV_VALUE 9       /* id is the value of the preceding event */
+
+/* Stages in timeline events; IF is implied by EV_FETCH */
+#define STAGE_IF 0
+#define STAGE_ID 1
+#define STAGE_EX 2
+#define STAGE_MEM 3
+#define STAGE_WB 4
+#define STAGE_DISPATCH 5 /* Out-of-order model: renamed into the reorder buffer */
+#define STAGE_ISSUE 6    /* Out-of-order model: started execution */
+#define STAGE_COMPLETE 7 /* Out-of-order model: result available */
+
+/* Stall reasons in timeline events */
+#define STALL_LOADUSE 0  /* Load-use hazard */
+#define STALL_DEPEND 1   /* Dependence on an older instruction in the same issue group */
+#define STALL_PORT 2     /* Second load or store in the same issue group */
+#define STALL_FETCH 3    /* Instruction cache miss */
+#define STALL_MEMORY 4   /* Data cache miss */
+#define STALL_ROB 5      /* Dispatch: reorder buffer full */
+#define STALL_IQ 6       /* Dispatch: issue queue full */
+#define STALL_LSQ 7      /* Dispatch: load/store queue full */
+#define STALL_REGS 8     /* Dispatch: no free rename register */
+
+/* Forwarding paths in timeline events */
+#define FWD_EXMEM_A 0    /* (1a) ForwardA = 10 */
+#define FWD_MEMWB_A 1    /* (2a) ForwardA = 01 */
+#define FWD_EXMEM_B 2    /* (1b) ForwardB = 10 */
+#define FWD_MEMWB_B 3    /* (2b) ForwardB = 01 */
+#define FWD_STORE 4      /* Out-of-order model: load value from an older store */
+#define NUMFWD 5
+
+/* CPI stack categories: what each retirement slot of each cycle is charged to */
+#define CPI_BASE 0       /* An instruction retired, or the pipeline was filling or draining */
+#define CPI_HAZARD 1     /* Waiting on a data dependence: load-use stall, split issue group, operands */
+#define CPI_BRANCH 2     /* Refetching after a mispredicted branch, or a fetch group ended by a taken one */
+#define CPI_MEMORY 3     /* Waiting for the instruction or data cache */
+#define NUMCPI 4
+
+/* Formats of exported statistics */
+#define STATS_JSON 0     /* One JSON object per line */
+#define STATS_CSV 1      /* A header line, then one line per dump */
+
+/* Features compiled into a variant of the in-order pipeline, see selectPipeline */
+#define V_TRACE 1        /* The state and the stall/forwarding messages may be printed */
+#define V_CACHES 2       /* Instruction or data cache, or a cache stall left in a checkpoint */
+#define V_PREDICT 4      /* A branch predictor other than static not-taken */
+#define V_HOOKS 8        /* Timeline, checker or coherence logging */
+#define V_LANES 16       /* Other configurations follow this pipeline in lockstep */
+#define NUMVARIANTS 32
+
+/* Inline a function into every caller, so that its constant arguments are folded */
+#ifdef __GNUC__
+#define SPECIALIZE __attribute__((always_inline)) inline
+#else
+#define SPECIALIZE inline
+#endif
+
+/* Kinds of trace records passed to the trace writer thread */
+#define TR_STATE 0       /* The state printed at the beginning of a cycle */
+#define TR_TEXT 1        /* A message, such as a stall or forwarding line */
+#define TR_ROB 2         /* Heading of the reorder buffer contents */
+#define TR_ROBENTRY 3    /* One reorder buffer entry, oldest first */
+#define TR_END 4         /* The simulation is over */
+#define TRACESLOTS 4096  /* Records in the trace ring buffer, a power of two */
+#define TRACEBUFFER (1 << 20)  /* Bytes of standard output buffered by the writer */
+#define TRACESPINS 64    /* Times a thread yields on an empty or full ring before sleeping */
+#define LOCKSTEPSLICE 10000  /* Instructions a lockstep group retires between attempts to merge groups */
+#define HISTSNAP 1024    /* Cycles between snapshots of the state in a debugging history */
+#define HISTWORDS (sizeof(stateType) / sizeof(int))  /* Words of stateType a history records */
+#define HISTHASH(word, cap) (((unsigned int)(word) * 2654435761u) & ((cap) - 1))  /* First slot for a word in memWrites */
+
+typedef struct decodedStruct {
   unsigned int instr;              /* Integer representation of instruction */
+  unsigned char op;                /* Decoded operation (OP_ value) */
+  unsigned char rs;                /* Number of rs register */
+  unsigned char rt;                /* Number of rt register */
+  unsigned char rd;                /* Number of rd register, 0 if not R-type */
+  int immed;                       /* Sign-extended immediate field */
+} decodedType;
+
+typedef struct uopStruct {
+  unsigned char op;                /* XOP_ value */
+  unsigned char rs;                /* Register numbers, as in decodedType */
+  unsigned char rt;
+  unsigned char rd;
+  int immed;                       /* Sign-extended immediate field */
+  int offset;                      /* Number of instructions before this one in the block */
+} uopType;
+
+typedef struct blockStruct {
+  int pc;                          /* Address of the first instruction */
+  int length;                      /* Number of instructions, NOOPs and the BNE included */
+  int nextPc;                      /* Address of the instruction after the block */
+  int takenPc;                     /* Target of the BNE ending the block, if it does */
+  struct blockStruct *taken;       /* Block at takenPc, NULL until the branch is first taken */
+  struct blockStruct *fallThrough; /* Block at nextPc, NULL until it is first reached */
+  uopType ops[];                   /* Operations, ending in XOP_BNE, XOP_NEXT or XOP_EXIT */
+} blockType;
+
+typedef struct IFIDStruct {
+  int instr;                       /* Index of instruction in decodedMem */
   int PCPlus4;                     /* PC + 4 */
+  int predTaken;                   /* Nonzero if fetch followed a taken prediction */
+  unsigned int predHist;           /* Global branch history used for the prediction */
+  unsigned int id;                 /* Dynamic instruction number, 0 for a bubble */
+  int cause;                       /* CPI_ category a bubble in this slot is charged to */
 } IFIDType;
 
 typedef struct IDEXStruct {
-  unsigned int instr;              /* Integer representation of instruction */
+  int instr;                       /* Index of instruction in decodedMem */
   int PCPlus4;                     /* PC + 4 */
   int readData1;                   /* Contents of rs register */
   int readData2;                   /* Contents of rt register */
@@ -37,45 +274,1158 @@ typedef struct IDEXStruct {
   int rtReg;                       /* Number of rt register */
   int rdReg;                       /* Number of rd register */
   int branchTarget;                /* Branch target, obtained from immediate field */
+  int predTaken;                   /* Nonzero if fetch followed a taken prediction */
+  unsigned int predHist;           /* Global branch history used for the prediction */
+  unsigned int id;                 /* Dynamic instruction number, 0 for a bubble */
+  int cause;                       /* CPI_ category a bubble in this slot is charged to */
 } IDEXType;
 
 typedef struct EXMEMStruct {
-  unsigned int instr;              /* Integer representation of instruction */
+  int instr;                       /* Index of instruction in decodedMem */
   int aluResult;                   /* Result of ALU operation */
   int writeDataReg;                /* Contents of the rt register, used for store word */
   int writeReg;                    /* The destination register */
+  unsigned int id;                 /* Dynamic instruction number, 0 for a bubble */
+  int cause;                       /* CPI_ category a bubble in this slot is charged to */
 } EXMEMType;
 
 typedef struct MEMWBStruct {
-  unsigned int instr;              /* Integer representation of instruction */
+  int instr;                       /* Index of instruction in decodedMem */
   int writeDataMem;                /* Data read from memory */
   int writeDataALU;                /* Result from ALU operation */
   int writeReg;                    /* The destination register */
+  unsigned int id;                 /* Dynamic instruction number, 0 for a bubble */
+  int cause;                       /* CPI_ category a bubble in this slot is charged to */
 } MEMWBType;
 
+typedef struct pipeStruct {
+  IFIDType IFID[MAXWIDTH];                /* IFID pipeline register, one slot per issue lane */
+  IDEXType IDEX[MAXWIDTH];                /* IDEX pipeline register */
+  EXMEMType EXMEM[MAXWIDTH];              /* EXMEM pipeline register */
+  MEMWBType MEMWB[MAXWIDTH];              /* MEMWB pipeline register */
+} pipeType;
+
 typedef struct stateStruct {
   int PC;                                 /* Program Counter */
-  unsigned int instrMem[NUMMEMORY];       /* Instruction memory */
-  int dataMem[NUMMEMORY];                 /* Data memory */
+  unsigned int *instrMem;                 /* Instruction memory */
+  int numInstrMem;                        /* Number of words in instruction memory */
+  decodedType *decodedMem;                /* Pre-decoded instruction memory, see DECODEDINDEX */
+  blockType **blocks;                     /* Translated block starting at each instruction, see */
+                                          /* runBlocks; NULL until the first functional run */
+  int *dataMem;                           /* Data memory */
+  int numDataMem;                         /* Number of words in data memory */
   int regFile[NUMREGS];                   /* Register file */
-  IFIDType IFID;                          /* Current IFID pipeline register */
-  IDEXType IDEX;                          /* Current IDEX pipeline register */
-  EXMEMType EXMEM;                        /* Current EXMEM pipeline register */
-  MEMWBType MEMWB;                        /* Current MEMWB pipeline register */
-  int cycles;                             /* Number of cycles executed so far */
+  pipeType pipe[2];                       /* Double-buffered pipeline registers */
+  int cur;                                /* Index of the current pipeline registers in pipe[] */
+  long long cycles;                       /* Number of cycles executed so far */
+  int fault;                              /* Nonzero once a load or store went out of range, */
+                                          /* or the checker found a divergence */
+  int memStall;                           /* Cycles left before the load or store in MEM completes */
+  int memDone;                            /* Nonzero once the cache has been accessed for that load or store */
+  int fetchStall;                         /* Cycles left before the instruction at PC can be fetched */
+  int fetchDone;                          /* Nonzero once the instruction cache has been accessed for PC */
+  int width;                              /* Issue width, the number of slots used in each pipeline register */
+                                          /* (0 for the out-of-order model, which does not use them) */
+  unsigned int nextId;                    /* Dynamic instruction number of the next instruction fetched */
 } stateType;
 
-
-void run();
+typedef struct labelStruct {
+  int name;                               /* Offset of the name in labelNames */
+  int value;                              /* Byte address */
+  int isData;                             /* Nonzero for a data address, zero for an instruction address */
+} labelType;
+
+typedef struct programStruct {
+  unsigned int *instr;                    /* Encoded instructions */
+  int numInstr;                           /* Number of instructions */
+  int *data;                              /* Initial contents of data memory */
+  int numData;                            /* Number of data words */
+  labelType *labels;                      /* Labels defined by the program */
+  int numLabels;                          /* Number of labels */
+  char *labelNames;                       /* NUL-terminated label names */
+  int labelNamesSize;                     /* Size of labelNames in bytes */
+  struct imageStruct *image;              /* Binary image the fields above point into, or NULL */
+  size_t imageSize;                       /* Size of the image in bytes */
+  int imageFd;                            /* File the image is mapped from, or -1 if it was read */
+} programType;
+
+typedef struct imageStruct {
+  char magic[8];                          /* IMAGEMAGIC */
+  unsigned int version;                   /* IMAGEVERSION */
+  unsigned int decodedSize;               /* sizeof(decodedType), to catch layout changes */
+  int numInstr;                           /* Number of instructions */
+  int numData;                            /* Number of data words */
+  int numLabels;                          /* Number of labels */
+  int labelNamesSize;                     /* Size of the label names in bytes */
+  long long labelsOffset;                 /* File offsets of the labels, the label names, */
+  long long labelNamesOffset;             /* the instructions, the initial data and the */
+  long long instrOffset;                  /* decoded instructions (numInstr + 1 of them, */
+  long long dataOffset;                   /* starting with the NOOP at NOOPINDEX); the */
+  long long decodedOffset;                /* last three are CKPTALIGN-aligned */
+} imageType;
+
+typedef struct symbolStruct {
+  const char *name;                       /* Label name in the source text, NULL if the slot is empty */
+  int len;                                /* Length of the name */
+  int line;                               /* Line where the label is defined */
+  int value;                              /* Byte address */
+  int isData;                             /* Nonzero for a data address */
+} symbolType;
+
+typedef struct asmStruct {
+  const char *name;                       /* File name, for error messages */
+  const char *p;                          /* Next character of the current line */
+  const char *end;                        /* End of the current line */
+  int line;                               /* Current line number */
+  int pass;                               /* 1 to find labels, 2 to encode */
+  int errors;                             /* Number of errors reported */
+  int numInstr;                           /* Instructions assembled so far */
+  int numData;                            /* Data words assembled so far */
+  symbolType *symbols;                    /* Open-addressing hash table of labels */
+  int symMask;                            /* Size of symbols - 1 */
+  int numSymbols;                         /* Number of labels */
+  symbolType **pending;                   /* Labels waiting for the next address */
+  int numPending;                         /* Number of pending labels */
+  programType *program;                   /* Program being assembled */
+} asmType;
+
+typedef struct btbEntryStruct {
+  int pc;                                 /* Address of the branch, -1 if the entry is empty */
+  int target;                             /* Branch target */
+} btbEntryType;
+
+typedef struct predictorStruct {
+  int type;                               /* BP_ value */
+  unsigned int mask;                      /* Number of counter table entries - 1 */
+  unsigned char *bimodal;                 /* 2-bit counters indexed by PC */
+  unsigned char *gshare;                  /* 2-bit counters indexed by PC xor history */
+  unsigned char *chooser;                 /* 2-bit counters, taken selects gshare */
+  unsigned int history;                   /* Global history of resolved branches */
+  btbEntryType *btb;                      /* Direct-mapped branch target buffer */
+  unsigned int btbMask;                   /* Number of BTB entries - 1 */
+} predictorType;
+
+typedef struct cacheStatsStruct {
+  long long hits;                         /* Accesses that found their line */
+  long long misses;                       /* Accesses that did not */
+  long long evictions;                    /* Valid lines replaced */
+  long long writebacks;                   /* Dirty lines written to the next level */
+} cacheStatsType;
+
+typedef struct cacheStruct {
+  unsigned int *tags;                     /* Line address + 1 per way, 0 if invalid; a set's ways are adjacent */
+  unsigned int *stamps;                   /* Time of last use (LRU) or fill (FIFO) per way */
+  unsigned char *dirty;                   /* Per way, nonzero if the line was written (write-back only) */
+  int ways;                               /* Associativity */
+  int lineShift;                          /* log2 of the line size in bytes */
+  unsigned int setMask;                   /* Number of sets - 1 */
+  int latency;                            /* Extra cycles for a hit in this level */
+  int replacement;                        /* REPL_ value */
+  int writeThrough;                       /* Nonzero for write-through, no-write-allocate */
+  unsigned int clock;                     /* Access counter for stamps */
+  unsigned int seed;                      /* State of the random replacement generator */
+  struct cacheStruct *next;               /* Next level, NULL for main memory */
+  int memLatency;                         /* Cycles to main memory when next is NULL */
+  cacheStatsType stats;                   /* Counters for this level */
+} cacheType;
+
+typedef struct cacheConfigStruct {
+  int size;                               /* Capacity in bytes, 0 if the level is absent */
+  int ways;                               /* Associativity */
+  int line;                               /* Line size in bytes */
+  int latency;                            /* Extra cycles for a hit */
+} cacheConfigType;
+
+typedef struct statsStruct {
+  long long instructions;                 /* Instructions retired, not counting HALT */
+  long long numStalls;                    /* Load-use stalls */
+  long long numBranches;                  /* Branches resolved */
+  long long numMisPred;                   /* Mispredicted branches */
+  long long numMemStalls;                 /* Cycles the pipeline waited for a data cache miss */
+  long long numFetchStalls;               /* Bubbles fetched while waiting for an instruction cache miss */
+  long long numDepSplits;                 /* Issue groups cut short by a dependence inside the group */
+  long long numPortSplits;                /* Issue groups cut short by a second load or store */
+  long long numRobFull;                   /* Dispatch stalls on a full reorder buffer */
+  long long numIqFull;                    /* Dispatch stalls on a full issue queue */
+  long long numLsqFull;                   /* Dispatch stalls on a full load/store queue */
+  long long numRegsFull;                  /* Dispatch stalls for lack of a rename register */
+  long long numFlushed;                   /* Instructions squashed by mispredicted branches */
+  long long forwards[NUMFWD];             /* Operands forwarded, by FWD_ path */
+  long long opCounts[NUMOPS];             /* Instructions retired, by OP_ value, HALT included */
+  long long busy[4];                      /* Slots of IF/ID, ID/EX, EX/MEM and MEM/WB holding an */
+                                          /* instruction, summed over the cycles */
+  long long robBusy;                      /* Reorder buffer entries in use, summed over the cycles */
+  long long iqBusy;                       /* Issue queue entries in use, summed over the cycles */
+  long long lsqBusy;                      /* Load/store queue entries in use, summed over the cycles */
+  long long cpiSlots[NUMCPI];             /* Retirement slots (width per cycle) by CPI_ category */
+  long long numInvalidations;             /* Data cache lines invalidated by other cores' stores */
+} statsType;
+
+typedef struct counterStruct {
+  const char *name;                       /* Name in exported statistics */
+  size_t offset;                          /* Offset of the counter in statsType */
+} counterType;
+
+typedef struct robEntryStruct {
+  int instr;                              /* Index of the instruction in decodedMem */
+  int pc;                                 /* Address of the instruction */
+  int status;                             /* ROB_ value */
+  int dest;                               /* Rename register written, -1 if none */
+  int src[2];                             /* Rename registers awaited for rs and rt, -1 once the value is known */
+  int value[2];                           /* Values of rs and rt */
+  int result;                             /* Value written to dest */
+  int addr;                               /* Address of a load or store */
+  long long doneAt;                       /* Cycle in which execution completes */
+  int predTaken;                          /* Direction predicted in fetch */
+  unsigned int predHist;                  /* Global history used for the prediction */
+  int taken;                              /* Resolved direction of a branch */
+  int mispredicted;                       /* Nonzero if the branch was mispredicted */
+  int missed;                             /* Nonzero if a load missed in the data cache */
+  unsigned int id;                        /* Dynamic instruction number */
+} robEntryType;
+
+typedef struct fetchEntryStruct {
+  int instr;                              /* Index of the instruction in decodedMem */
+  int pc;                                 /* Address of the instruction */
+  int predTaken;                          /* Nonzero if predicted taken */
+  unsigned int predHist;                  /* Global history used for the prediction */
+  unsigned int id;                        /* Dynamic instruction number */
+} fetchEntryType;
+
+typedef struct oooStruct {
+  robEntryType *rob;                      /* Reorder buffer, a ring of robSize entries */
+  int robSize;                            /* Number of entries */
+  int robHead;                            /* Index of the oldest entry */
+  int robCount;                           /* Number of entries in use */
+  int iqSize;                             /* Issue queue entries */
+  int iqCount;                            /* Entries waiting to issue */
+  int lsqSize;                            /* Load/store queue entries */
+  int lsqCount;                           /* Loads and stores in the reorder buffer */
+  int numPregs;                           /* Number of rename registers */
+  int *pregValue;                         /* Value of each rename register */
+  unsigned char *pregReady;               /* Nonzero once the value has been computed */
+  int *freeList;                          /* Rename registers not in use */
+  int numFree;                            /* Number of entries in freeList */
+  int map[NUMREGS];                       /* Rename register holding the newest value of each */
+                                          /* architectural register, -1 if regFile holds it */
+  fetchEntryType fetchQueue[2 * MAXWIDTH];/* Fetched instructions waiting for dispatch, a ring */
+  int fqHead;                             /* Index of the oldest fetched instruction */
+  int fqCount;                            /* Number of fetched instructions */
+  unsigned int redirectId;                /* Mispredicted branch whose correct path has not started */
+                                          /* committing yet, 0 if none */
+} oooType;
+
+typedef struct eventStruct {
+  unsigned int id;                        /* Dynamic instruction number, see the EV_ kinds */
+  unsigned short delta;                   /* Cycles since the previous event */
+  unsigned char kind;                     /* EV_ value */
+  unsigned char arg;                      /* Kind-specific: STAGE_, STALL_ or FWD_ value, or branch outcome */
+} eventType;
+
+typedef struct timelineHeaderStruct {
+  char magic[8];                          /* TIMELINEMAGIC */
+  unsigned int version;                   /* TIMELINEVERSION */
+  unsigned int eventSize;                 /* sizeof(eventType), to catch layout changes */
+  unsigned int firstId;                   /* Number of the first instruction fetched; earlier ones */
+                                          /* may still appear, if the pipeline was not empty */
+  long long startCycle;                   /* Cycle the first event's delta counts from */
+} timelineHeaderType;
+
+typedef struct timelineStruct {
+  FILE *file;                             /* Trace being written */
+  char *name;                             /* Its name, for error messages */
+  int error;                              /* Nonzero once a write failed */
+  long long lastCycle;                    /* Cycle of the last event */
+  eventType events[TIMELINEBUFFER];       /* Events not written yet */
+  int numEvents;                          /* Number of events in events[] */
+  unsigned char *described;               /* Per decodedMem index, nonzero once an EV_INSTR was written */
+} timelineType;
+
+typedef struct configStruct {
+  int traceAll;                           /* Print the state at the beginning of every cycle */
+  int traceEvery;                         /* If nonzero, print the state every traceEvery cycles */
+  int traceFirst;                         /* First cycle of the trace window, 0 if no window */
+  int traceLast;                          /* Last cycle of the trace window */
+  int instrWords;                         /* Instruction memory size in words, 0 to size from the program */
+  int dataWords;                          /* Data memory size in words, 0 to size from the program */
+  int bpType;                             /* Branch predictor type, BP_ value */
+  int bpEntries;                          /* Entries in each branch predictor table */
+  int btbEntries;                         /* Entries in the branch target buffer */
+  long long fastForward;                  /* Instructions to execute functionally before the pipeline */
+  int functional;                         /* Nonzero to run the whole program functionally */
+  long long sampleUnit;                   /* Instructions measured per sample, 0 to not sample */
+  long long sampleWarm;                   /* Instructions of pipeline warm-up before each sample */
+  long long sampleSkip;                   /* Instructions fast-forwarded between samples */
+  char *manifest;                         /* Batch manifest file, NULL for a single run */
+  int threads;                            /* Batch worker threads, 0 for one per processor */
+  char *saveFile;                         /* Checkpoint to write, NULL for none */
+  long long saveAt;                       /* Cycle at which to write saveFile */
+  char *restoreFile;                      /* Checkpoint to start from instead of a program */
+  char *imageFile;                        /* Binary image to write instead of simulating, NULL for none */
+  cacheConfigType cache[NUMCACHES];       /* Cache geometry, indexed by CACHE_ level */
+  int memLatency;                         /* Main memory latency in cycles */
+  int replacement;                        /* Cache replacement policy, REPL_ value */
+  int writeThrough;                       /* Nonzero for a write-through, no-write-allocate L1 data cache */
+  int width;                              /* Instructions fetched, issued and retired per cycle */
+  int ooo;                                /* Nonzero for the out-of-order back end */
+  int robSize;                            /* Reorder buffer entries */
+  int iqSize;                             /* Issue queue entries */
+  int lsqSize;                            /* Load/store queue entries */
+  int physRegs;                           /* Rename registers */
+  char *timelineFile;                     /* Timeline trace to write, NULL for none */
+  char *konataFile;                       /* Timeline trace to print as a Kanata log instead of simulating */
+  char *statsFile;                        /* File to export the counters to, NULL for none */
+  int statsFormat;                        /* STATS_ value */
+  long long statsInterval;                /* If nonzero, also export every statsInterval cycles */
+  int cpiStack;                           /* Nonzero to print the CPI stack with the results */
+  int benchSize;                          /* If nonzero, run the benchmark kernels at this size */
+  int kernel;                             /* KERNEL_ value to print instead of simulating, -1 for none */
+  int check;                              /* Nonzero to check every retired instruction against a reference */
+  int cores;                              /* Simulated cores sharing the data memory */
+  int quantum;                            /* Cycles the cores run between synchronizations */
+  int coherence;                          /* Nonzero to keep the cores' data caches coherent */
+  int lockstep;                           /* Nonzero to run compatible batch jobs in lockstep */
+  char *debugFile;                        /* Debugger commands to answer after the run, NULL for none */
+} configType;
+
+/* Names of the benchmark kernels, indexed by KERNEL_ value */
+const char *kernelNames[NUMKERNELS] = {"sum", "copy", "chase", "loop", "chain"};
+
+typedef struct resultStruct {
+  statsType stats;                        /* Counters from the pipeline model */
+  long long cycles;                       /* Cycles simulated by the pipeline model */
+  long long fastForwarded;                /* Instructions executed functionally before the pipeline */
+  long long instructions;                 /* Instructions executed in all modes */
+  int fault;                              /* Nonzero if a load or store went out of range */
+  int samples;                            /* Units measured in sampled simulation */
+  double estimate[3];                     /* Sampled CPI, stalls per instruction and misprediction rate */
+  double confidence[3];                   /* 95% confidence interval half-widths of estimate[] */
+  cacheStatsType cache[NUMCACHES];        /* Cache counters, indexed by CACHE_ level */
+  long long checked;                      /* Instructions checked against the reference model */
+  int cores;                              /* Simulated cores */
+  long long coreCycles[MAXCORES];         /* Cycles each core ran for */
+  long long coreInstructions[MAXCORES];   /* Instructions each core retired */
+} resultType;
+
+typedef struct retireStruct {
+  long long cycle;                        /* Cycle the instruction retired in */
+  int pc;                                 /* Address of the instruction */
+  int reg;                                /* Register written, -1 if none */
+  int addr;                               /* Data address stored to, -1 if none */
+  int value;                              /* Value written to reg or addr */
+} retireType;
+
+typedef struct checkerStruct {
+  int PC;                                 /* Reference program counter */
+  int regFile[NUMREGS];                   /* Reference register file */
+  int *dataMem;                           /* Reference data memory */
+  int numDataMem;                         /* Number of words in dataMem */
+  unsigned int *instrMem;                 /* Instruction memory of the simulated machine, never written */
+  int numInstrMem;                        /* Number of words in instrMem */
+  long long checked;                      /* Instructions the reference model has executed */
+  retireType log[CHECKBATCH + MAXWIDTH];  /* Instructions retired but not checked yet, oldest first */
+  int numLog;                             /* Number of entries in log */
+} checkerType;
+
+typedef struct traceRecordStruct {
+  int kind;                               /* TR_ value */
+  union {
+    const char *text;                     /* TR_TEXT: a string constant */
+    struct {                              /* TR_STATE: what printState prints */
+      long long cycles;
+      int PC;
+      int width;
+      int dataMem[NUMMEMORY];
+      int regFile[NUMREGS];
+      pipeType pipe;                      /* Current pipeline registers */
+    } state;
+    struct {                              /* TR_ROB */
+      int count;                          /* Entries in use */
+      int size;                           /* Entries in the reorder buffer */
+    } rob;
+    struct {                              /* TR_ROBENTRY */
+      int pc;
+      int status;                         /* ROB_ value */
+      int instr;                          /* Index of the instruction in decodedMem */
+    } entry;
+  } u;
+} traceRecordType;
+
+typedef struct traceRingStruct {
+  traceRecordType slots[TRACESLOTS];      /* Records, filled in by the simulation thread only */
+  atomic_ulong head;                      /* Number of records the writer has printed */
+  atomic_ulong tail;                      /* Number of records the simulation has filled in */
+  decodedType *decodedMem;                /* Decoded instructions, only read while the writer runs */
+  pthread_t thread;                       /* Writer thread */
+} traceRingType;
+
+typedef struct flipStruct {
+  int word;                               /* Word of stateType, see HISTWORDS */
+  unsigned int bits;                      /* Bits of it the cycle changed */
+} flipType;
+
+typedef struct storeStruct {
+  int word;                               /* Data memory word */
+  int old;                                /* Its value before the store */
+  int value;                              /* Its value after the store */
+} storeType;
+
+typedef struct stepStruct {
+  long long flips;                        /* Index of the cycle's first flip */
+  long long stores;                       /* Index of the cycle's first store */
+} stepType;
+
+typedef struct writesStruct {
+  long long *cycles;                      /* Recorded cycles that changed a word, oldest first; */
+                                          /* NULL for an empty slot of memWrites */
+  long long num;                          /* Number of cycles */
+  long long cap;                          /* Allocated size of cycles */
+  int word;                               /* Data memory word, in memWrites */
+} writesType;
+
+typedef struct historyStruct {
+  FILE *commands;                         /* Debugger commands */
+  stateType shadow;                       /* The state after the last recorded cycle, with pipe[0] */
+                                          /* the current pipeline registers and pipe[1] cleared */
+  stateType *snaps;                       /* Like shadow, every HISTSNAP cycles from the first */
+  long long numSnaps;                     /* Number of snapshots */
+  long long capSnaps;                     /* Allocated size of snaps */
+  stepType *steps;                        /* Where each recorded cycle's changes start, and one more */
+  long long numSteps;                     /* Number of recorded cycles */
+  long long capSteps;                     /* Allocated size of steps */
+  flipType *flips;                        /* Changes to stateType, cycle by cycle */
+  long long numFlips;                     /* Number of flips */
+  long long capFlips;                     /* Allocated size of flips */
+  storeType *stores;                      /* Changes to data memory, cycle by cycle */
+  long long numStores;                    /* Number of stores */
+  long long capStores;                    /* Allocated size of stores */
+  writesType regWrites[NUMREGS];          /* Cycles that changed each register */
+  writesType *memWrites;                  /* Hash table of the cycles that changed each data memory */
+                                          /* word stored to, see findWrites */
+  long long numMemWrites;                 /* Words in memWrites */
+  long long capMemWrites;                 /* Size of memWrites, a power of two, 0 before the first store */
+  stateType view;                         /* State the debugger shows, with its own data memory */
+  long long at;                           /* Number of recorded cycles before view */
+} historyType;
+
+struct simStruct;
+typedef int (*cycleFnType)(struct simStruct*, int);  /* A variant of the in-order pipeline */
+
+typedef struct simStruct {
+  stateType state;                        /* Architectural state and pipeline registers */
+  predictorType pred;                     /* Branch predictor and branch target buffer */
+  cacheType cache[NUMCACHES];             /* Memory hierarchy, indexed by CACHE_ level */
+  oooType *ooo;                           /* Out-of-order back end, NULL for the in-order pipeline */
+  timelineType *timeline;                 /* Timeline trace being written, NULL for none */
+  FILE *statsOut;                         /* Exported counters being written, NULL for none */
+  int statsDumps;                         /* Number of times the counters have been exported */
+  checkerType *checker;                   /* Reference model checking retirement, NULL for none */
+  traceRingType *tracer;                  /* Trace records waiting to be printed, NULL if not tracing */
+  unsigned int *written;                  /* Data cache lines stored to since the cores last synchronized, */
+                                          /* NULL unless the other cores' caches are kept coherent */
+  int numWritten;                         /* Number of lines in written */
+  int capWritten;                         /* Allocated size of written */
+  statsType stats;                        /* Statistics counters */
+  configType *config;                     /* Simulator options */
+  cycleFnType pipeline;                   /* In-order pipeline variant, NULL until the first cycle */
+  struct simStruct *nextLane;             /* Next configuration following this one's pipeline, NULL if none */
+  struct lockstepStruct *lockstep;        /* Lockstep simulation this is a lane of, NULL if not one */
+  historyType *history;                   /* Cycles recorded for the debugger, NULL if not recording */
+} simType;
+
+typedef struct lockstepStruct {
+  simType *lanes;                         /* One simulation per configuration */
+  configType *configs;                    /* Their options */
+  int numLanes;                           /* Number of lanes */
+  simType **ready;                        /* Lanes leading a group of lanes that has not finished */
+  int numReady;                           /* Number of lanes in ready */
+  statsType *offsets;                     /* Per lane, what to add to its leader's counters and */
+  long long *cycleOffsets;                /* cycles to get its own (see mergeLanes) */
+  int *dataMem;                           /* Data memory of the first lane, freed with its state */
+  int *failed;                            /* Per lane, nonzero if it could not split off (see laneSplit) */
+} lockstepType;
+
+typedef struct cacheSaveStruct {
+  int lines;                              /* Number of lines, 0 if the level is absent */
+  int ways;                               /* cacheType fields the saved arrays depend on */
+  int lineShift;
+  int replacement;
+  int writeThrough;
+  unsigned int clock;                     /* cacheType state besides the arrays */
+  unsigned int seed;
+  cacheStatsType stats;
+} cacheSaveType;
+
+typedef struct checkpointStruct {
+  char magic[8];                          /* CKPTMAGIC */
+  unsigned int version;                   /* CKPTVERSION */
+  unsigned int pipeSize;                  /* sizeof(pipeType), to catch layout changes */
+  int PC;                                 /* Program Counter */
+  int numInstrMem;                        /* Number of words in instruction memory */
+  int numDataMem;                         /* Number of words in data memory */
+  int savedInstrMem;                      /* Words of instruction memory stored, without trailing zeros */
+  int savedDataMem;                       /* Words of data memory stored, without trailing zeros */
+  int regFile[NUMREGS];                   /* Register file */
+  long long cycles;                       /* Number of cycles executed so far */
+  pipeType pipe;                          /* Current pipeline registers */
+  statsType stats;                        /* Statistics counters */
+  int bpType;                             /* Branch predictor type, BP_ value */
+  unsigned int bpMask;                    /* Number of counter table entries - 1 */
+  unsigned int btbMask;                   /* Number of BTB entries - 1 */
+  unsigned int history;                   /* Global branch history */
+  int memStall;                           /* stateType memStall, memDone, fetchStall and fetchDone */
+  int memDone;
+  int fetchStall;
+  int fetchDone;
+  int width;                              /* Issue width the pipeline registers were saved with */
+  unsigned int nextId;                    /* Next dynamic instruction number */
+  cacheSaveType cache[NUMCACHES];         /* Geometry and state of each cache level */
+  long long instrOffset;                  /* File offset of the instruction memory image */
+  long long dataOffset;                   /* File offset of the data memory image */
+} checkpointType;
+
+typedef struct dequeStruct {
+  pthread_mutex_t lock;                   /* Protects head and tail */
+  int *jobs;                              /* Indices of the jobs given to this worker */
+  int head;                               /* Next job to steal */
+  int tail;                               /* One past the next job for the owner to run */
+} dequeType;
+
+typedef struct poolStruct {
+  char **jobs;                            /* Manifest lines: program file and options */
+  int *lineNums;                          /* Manifest line number of each job */
+  int numJobs;                            /* Number of jobs */
+  dequeType *deques;                      /* One work-stealing deque per worker */
+  int numThreads;                         /* Number of workers */
+  configType *config;                     /* Command line options, applied before each job's own */
+  pthread_mutex_t outLock;                /* Serializes result lines */
+  int *groupNext;                         /* Per job, the next job run in lockstep with it, -1 if none; */
+                                          /* NULL without -lockstep */
+} poolType;
+
+typedef struct workerStruct {
+  poolType *pool;                         /* Shared pool */
+  int id;                                 /* Index of this worker's deque */
+} workerType;
+
+typedef struct barrierStruct {
+  pthread_mutex_t lock;                   /* Protects the fields below */
+  pthread_cond_t open;                    /* Signaled when the last thread arrives */
+  int count;                              /* Threads that meet at the barrier */
+  int waiting;                            /* Threads waiting at the barrier now */
+  unsigned int generation;                /* Incremented every time the barrier opens */
+} barrierType;
+
+typedef struct multiStruct {
+  simType *cores;                         /* One machine per core, all sharing core 0's memories */
+  int *halted;                            /* Per core, nonzero once it has stopped */
+  int numCores;                           /* Number of cores */
+  int numThreads;                         /* Host threads simulating them */
+  long long quantumEnd;                   /* Cycle at which the current quantum ends */
+  int quantum;                            /* Cycles per quantum */
+  int done;                               /* Nonzero once every core has stopped, or one faulted */
+  barrierType barrier;                    /* Where the threads meet after each quantum */
+} multiType;
+
+typedef struct coreWorkerStruct {
+  multiType *multi;                       /* Shared machine */
+  int id;                                 /* This thread simulates cores id, id + numThreads, ... */
+} coreWorkerType;
+
+
+/* Every counter in statsType, in the order they are exported */
+const counterType counterTable[] = {
+    {"instructions", offsetof(statsType, instructions)},
+    {"load_use_stalls", offsetof(statsType, numStalls)},
+    {"branches", offsetof(statsType, numBranches)},
+    {"mispredicted", offsetof(statsType, numMisPred)},
+    {"flushed", offsetof(statsType, numFlushed)},
+    {"memory_stall_cycles", offsetof(statsType, numMemStalls)},
+    {"fetch_stall_cycles", offsetof(statsType, numFetchStalls)},
+    {"dependence_splits", offsetof(statsType, numDepSplits)},
+    {"port_splits", offsetof(statsType, numPortSplits)},
+    {"rob_full", offsetof(statsType, numRobFull)},
+    {"iq_full", offsetof(statsType, numIqFull)},
+    {"lsq_full", offsetof(statsType, numLsqFull)},
+    {"regs_full", offsetof(statsType, numRegsFull)},
+    {"forward_1a", offsetof(statsType, forwards[FWD_EXMEM_A])},
+    {"forward_2a", offsetof(statsType, forwards[FWD_MEMWB_A])},
+    {"forward_1b", offsetof(statsType, forwards[FWD_EXMEM_B])},
+    {"forward_2b", offsetof(statsType, forwards[FWD_MEMWB_B])},
+    {"forward_store", offsetof(statsType, forwards[FWD_STORE])},
+    {"op_noop", offsetof(statsType, opCounts[OP_NOOP])},
+    {"op_add", offsetof(statsType, opCounts[OP_ADD])},
+    {"op_sub", offsetof(statsType, opCounts[OP_SUB])},
+    {"op_lw", offsetof(statsType, opCounts[OP_LW])},
+    {"op_sw", offsetof(statsType, opCounts[OP_SW])},
+    {"op_bne", offsetof(statsType, opCounts[OP_BNE])},
+    {"op_halt", offsetof(statsType, opCounts[OP_HALT])},
+    {"ifid_busy", offsetof(statsType, busy[0])},
+    {"idex_busy", offsetof(statsType, busy[1])},
+    {"exmem_busy", offsetof(statsType, busy[2])},
+    {"memwb_busy", offsetof(statsType, busy[3])},
+    {"rob_busy", offsetof(statsType, robBusy)},
+    {"iq_busy", offsetof(statsType, iqBusy)},
+    {"lsq_busy", offsetof(statsType, lsqBusy)},
+    {"slots_base", offsetof(statsType, cpiSlots[CPI_BASE])},
+    {"slots_hazard", offsetof(statsType, cpiSlots[CPI_HAZARD])},
+    {"slots_branch", offsetof(statsType, cpiSlots[CPI_BRANCH])},
+    {"slots_memory", offsetof(statsType, cpiSlots[CPI_MEMORY])},
+    {"coherence_invalidations", offsetof(statsType, numInvalidations)},
+};
+#define NUMCOUNTERS (sizeof(counterTable) / sizeof(counterTable[0]))
+#define COUNTER(stats, i) (*(long long *)((char *)(stats) + counterTable[i].offset))
+
+int run(configType*);
+int simulate(configType*, programType*, resultType*);
+void printResult(configType*, resultType*);
+int loadProgram(FILE*, const char*, programType*);
+void asmError(asmType*, const char*, ...);
+void skipSpace(asmType*);
+int atLineEnd(asmType*);
+int expectChar(asmType*, char);
+int parseIdent(asmType*, const char**, int*);
+int parseNumber(asmType*, long long*);
+int parseReg(asmType*, int*);
+symbolType *findSymbol(asmType*, const char*, int);
+void defineLabel(asmType*, const char*, int);
+void bindLabels(asmType*, int);
+int parseValue(asmType*, long long*, symbolType**);
+int parseImmed(asmType*, int*, symbolType**);
+void emitWord(asmType*, int, unsigned int);
+void assembleLine(asmType*);
+void assemblePass(asmType*, const char*, size_t);
+void freeProgram(programType*);
+int loadImage(char*, size_t, int, const char*, programType*);
+int saveImage(programType*, char*);
+int runBatch(configType*);
+void *batchWorker(void*);
+int runJob(poolType*, int);
+int parseJob(char*, configType*, char**);
+void batchResult(configType*, resultType*, int, char*, size_t);
+void groupJobs(poolType*, int*);
+int canLockstep(configType*);
+int runLockstep(poolType*, int);
+void laneAccess(simType*, int, unsigned int, int, int);
+void lanePredict(simType*, int, int, unsigned int, int);
+void laneUpdate(simType*, int, unsigned int, int, int);
+simType *laneSplit(simType*, simType*);
+void mergeLanes(lockstepType*);
+int sameLane(stateType*, stateType*, unsigned int);
+void laneResults(lockstepType*, simType*, resultType*);
+int cycle(simType*, int);
+int cycleScalar(simType*, int, int);
+cycleFnType selectPipeline(simType*);
+int cycleWide(simType*, int);
+int cycleOoO(simType*, int);
+void initOoO(oooType*, configType*);
+void freeOoO(oooType*);
+void squashYounger(simType*, int);
+int runPipeline(simType*, long long);
+int drainPipeline(simType*);
+void runSampled(simType*, resultType*);
+int saveCheckpoint(simType*, char*);
+int restoreCheckpoint(simType*, char*);
+void *mapImage(int, long long, size_t, size_t);
+void resetPipeline(stateType*);
+void defaultConfig(configType*);
+int parseArgs(int, char**, configType*);
+int traceCycle(configType*, long long);
+void usage(char*);
 void printState(stateType*);
-void initState(stateType*);
-unsigned int instrToInt(char*, char*);
+int initState(stateType*, configType*, programType*);
+void freeState(stateType*);
+void *allocMemory(size_t);
+void freeMemory(void*, size_t);
+void decodeInstr(unsigned int, decodedType*);
+int parseSize(char*);
+int checkDataAddr(stateType*, int);
+int isPowerOfTwo(int);
+void initPredictor(predictorType*, configType*);
+void freePredictor(predictorType*);
+int predictBranch(predictorType*, int, unsigned int*, int*);
+void updatePredictor(predictorType*, int, unsigned int, int, int);
+long long runFunctional(stateType*, long long);
+long long runBlocks(stateType*, long long);
+blockType *findBlock(stateType*, int);
+blockType *translateBlock(stateType*, int);
+void freeBlocks(stateType*);
+void initCaches(cacheType*, configType*);
+void freeCaches(cacheType*);
+int cacheAccess(cacheType*, unsigned int, int);
+int parseCache(char*, cacheConfigType*, int);
 int get_opcode(unsigned int);
 void printInstruction(unsigned int);
+timelineType *openTimeline(char*, stateType*);
+int closeTimeline(timelineType*);
+void logEvent(timelineType*, long long, int, int, unsigned int, unsigned int);
+void putEvent(timelineType*, int, int, int, unsigned int);
+void logFetch(timelineType*, stateType*, unsigned int, int, int);
+void logPipeline(simType*, pipeType*, pipeType*);
+int printKonata(char*);
+void countPipeline(simType*, pipeType*, pipeType*);
+void dumpStats(simType*);
+void writeStat(FILE*, int, int, int, const char*, const char*);
+int runBench(configType*);
+int simulateCores(configType*, programType*, resultType*);
+void *coreWorker(void*);
+void syncCores(multiType*);
+int waitBarrier(barrierType*);
+void logWrite(simType*, int);
+int cacheInvalidate(cacheType*, unsigned int);
+int initChecker(simType*);
+void freeChecker(checkerType*);
+void logRetire(simType*, int, int, int, int);
+int checkRetired(simType*);
+int skipChecker(simType*, long long);
+int finishChecker(simType*);
+int stepReference(checkerType*, retireType*);
+void describeRetire(checkerType*, retireType*, char*, size_t);
+void writeKernel(FILE*, int, int);
+traceRingType *startTrace(stateType*);
+void stopTrace(traceRingType*);
+traceRecordType *traceSlot(traceRingType*);
+void tracePush(traceRingType*);
+void traceState(simType*);
+void traceText(simType*, const char*);
+void *traceWriter(void*);
+void traceWait(int*);
+historyType *startHistory(char*);
+void freeHistory(historyType*);
+void dropHistory(simType*);
+void *growList(void*, long long*, long long, size_t);
+void recordHistory(simType*);
+void logStore(simType*, int, int);
+int noteChange(writesType*, long long);
+writesType *findWrites(historyType*, int, int);
+long long lastChange(writesType*, long long);
+void seekHistory(historyType*, long long);
+int historyWord(historyType*, int, long long);
+void runDebugger(simType*);
+
+/* Record a timeline event in the current cycle, if a timeline is being written */
+#define LOGEVENT(sim, kind, arg, id, value) \
+    do { if ((sim)->timeline != NULL) \
+        logEvent((sim)->timeline, (sim)->state.cycles, kind, arg, id, value); } while (0)
+
+/* LOGEVENT in a pipeline variant, compiled out unless the variant has V_HOOKS */
+#define VLOGEVENT(sim, kind, arg, id, value) \
+    do { if (variant & V_HOOKS) LOGEVENT(sim, kind, arg, id, value); } while (0)
+
+int main(int argc, char *argv[]){
+    configType config;
+
+    defaultConfig(&config);
+    if (parseArgs(argc, argv, &config) != 0) {
+        usage(argv[0]);
+        return(1);
+    }
+    /* A trace is printed into one large buffer (see startTrace), which   */
+    /* must be set up before any output. A terminal stays line buffered so */
+    /* that error messages appear where they happen.                       */
+    if ((config.traceAll || config.traceEvery || config.traceFirst) && !isatty(STDOUT_FILENO))
+        setvbuf(stdout, NULL, _IOFBF, TRACEBUFFER);
+    if (config.konataFile != NULL)
+        return(printKonata(config.konataFile));
+    if (config.kernel >= 0) {
+        writeKernel(stdout, config.kernel, config.benchSize);
+        return(0);
+    }
+    if (config.benchSize > 0)
+        return(runBench(&config));
+    if (config.manifest != NULL)
+        return(runBatch(&config));
+    return(run(&config)); 
+}
+
+/*************************************************************/
+/* The usage function prints the command line options.       */
+/*************************************************************/
+void usage(char *prog){
+    fprintf(stderr, "usage: %s [options] < program.s\n", prog);
+    fprintf(stderr, "       %s [options] -b manifest [-j N]\n", prog);
+    fprintf(stderr, "       %s [options] -bench N\n", prog);
+    fprintf(stderr, "\t-q      quiet: only print the final statistics\n");
+    fprintf(stderr, "\t-t N    print the state every N cycles (cycles 1, N+1, 2N+1, ...)\n");
+    fprintf(stderr, "\t-w A:B  print the state for cycles A through B\n");
+    fprintf(stderr, "\t-i SIZE instruction memory size in bytes (K/M/G suffixes allowed)\n");
+    fprintf(stderr, "\t-m SIZE data memory size in bytes (K/M/G suffixes allowed)\n");
+    fprintf(stderr, "\t-bp TYPE[:N]  branch predictor: nottaken, bimodal (default), gshare or\n");
+    fprintf(stderr, "\t        tournament, with N entries per table (power of two, default %d)\n", BPENTRIES);
+    fprintf(stderr, "\t-btb N  branch target buffer entries (power of two, default %d)\n", BTBENTRIES);
+    fprintf(stderr, "\t-ff N   execute N instructions functionally, then switch to the pipeline\n");
+    fprintf(stderr, "\t-f      execute the whole program functionally (no timing)\n");
+    fprintf(stderr, "\t-s U:W:P  sampled simulation: every P instructions, measure U instructions\n");
+    fprintf(stderr, "\t        in the pipeline after W instructions of warm-up, and fast-forward\n");
+    fprintf(stderr, "\t        through the rest\n");
+    fprintf(stderr, "\t-b FILE run the jobs listed in FILE, one per line as a program file\n");
+    fprintf(stderr, "\t        followed by options, and print one result line per job\n");
+    fprintf(stderr, "\t-j N    number of batch worker threads, or of threads simulating the cores\n");
+    fprintf(stderr, "\t        (default: one per processor)\n");
+    fprintf(stderr, "\t-lockstep  simulate batch jobs that run the same program on the in-order\n");
+    fprintf(stderr, "\t        pipeline and differ only in branch predictor and cache options\n");
+    fprintf(stderr, "\t        together, sharing the pipeline work for as long as they agree\n");
+    fprintf(stderr, "\t-save N:FILE  write a checkpoint to FILE after N pipeline cycles\n");
+    fprintf(stderr, "\t-restore FILE start from a checkpoint instead of a program (in a batch\n");
+    fprintf(stderr, "\t        manifest, give - as the program file)\n");
+    fprintf(stderr, "\t-ic SIZE:WAYS:LINE  L1 instruction cache, given like -dc (default: none)\n");
+    fprintf(stderr, "\t-dc SIZE:WAYS:LINE  L1 data cache of SIZE bytes (K/M suffixes allowed) with\n");
+    fprintf(stderr, "\t        WAYS ways and LINE-byte lines (default: none, memory is single-cycle)\n");
+    fprintf(stderr, "\t-l2 SIZE:WAYS:LINE:LAT  L2 cache behind the L1 caches, hit in LAT cycles\n");
+    fprintf(stderr, "\t-mem N  main memory latency in cycles (default %d)\n", MEMLATENCY);
+    fprintf(stderr, "\t-repl POLICY  cache replacement: lru (default), fifo or random\n");
+    fprintf(stderr, "\t-wt     write-through, no-write-allocate L1 data cache (default: write-back)\n");
+    fprintf(stderr, "\t-width N  fetch, issue and retire up to N instructions per cycle, in order\n");
+    fprintf(stderr, "\t        (1 to %d, default 1)\n", MAXWIDTH);
+    fprintf(stderr, "\t-ooo    out-of-order back end with register renaming; -width sets the\n");
+    fprintf(stderr, "\t        fetch, dispatch, issue and commit width\n");
+    fprintf(stderr, "\t-rob N  reorder buffer entries (default %d)\n", ROBSIZE);
+    fprintf(stderr, "\t-iq N   issue queue entries (default %d)\n", IQSIZE);
+    fprintf(stderr, "\t-lsq N  load/store queue entries (default %d)\n", LSQSIZE);
+    fprintf(stderr, "\t-pregs N  rename registers (default %d)\n", PHYSREGS);
+    fprintf(stderr, "\t-o FILE assemble the program into a binary image in FILE and exit; images\n");
+    fprintf(stderr, "\t        are accepted wherever a program is and load without assembling\n");
+    fprintf(stderr, "\t-timeline FILE  record when every instruction enters each stage, with its\n");
+    fprintf(stderr, "\t        stalls, forwarding and branch outcome, in a compact binary FILE\n");
+    fprintf(stderr, "\t-konata FILE  print the timeline in FILE as a Kanata log for the Konata\n");
+    fprintf(stderr, "\t        pipeline viewer and exit\n");
+    fprintf(stderr, "\t-json FILE  export every counter and the CPI stack to FILE at the end of\n");
+    fprintf(stderr, "\t        the run, as one JSON object per line\n");
+    fprintf(stderr, "\t-csv FILE  the same as CSV, with a header line\n");
+    fprintf(stderr, "\t-interval N  also export the counters every N cycles\n");
+    fprintf(stderr, "\t-cpi    print the CPI stack: cycles per instruction charged to the base\n");
+    fprintf(stderr, "\t        pipeline, data hazards, branches and the memory hierarchy\n");
+    fprintf(stderr, "\t-cores N  simulate N cores (1 to %d) running the program on one shared data\n", MAXCORES);
+    fprintf(stderr, "\t        memory, each with its own pipeline and caches; core i starts with\n");
+    fprintf(stderr, "\t        $%d = i. Tracing is off with more than one core\n", COREREG);
+    fprintf(stderr, "\t-quantum N  cycles the cores run between synchronizations (default %d)\n", QUANTUM);
+    fprintf(stderr, "\t-coherent  a store invalidates the line in the other cores' data caches\n");
+    fprintf(stderr, "\t        when they next synchronize\n");
+    fprintf(stderr, "\t-check  check every instruction as it retires against a separate reference\n");
+    fprintf(stderr, "\t        model of the instruction set and stop at the first difference\n");
+    fprintf(stderr, "\t-bench N  run each benchmark kernel at size N with the other options and\n");
+    fprintf(stderr, "\t        print its CPI and simulated instructions and cycles per host second\n");
+    fprintf(stderr, "\t-kernel NAME:N  print the benchmark kernel NAME (sum, copy, chase, loop or\n");
+    fprintf(stderr, "\t        chain) at size N and exit\n");
+    fprintf(stderr, "\t-debug FILE  record every cycle of the in-order pipeline, then answer the\n");
+    fprintf(stderr, "\t        debugger commands in FILE (/dev/tty to type them): goto N, step [K],\n");
+    fprintf(stderr, "\t        back [K], reg R and mem A (the last change to regFile[R] or\n");
+    fprintf(stderr, "\t        dataMem[A] before the cycle shown), print and quit\n");
+}
+
+/*************************************************************/
+/* The defaultConfig function sets every option to its       */
+/* default. By default every cycle is traced.                */
+/*************************************************************/
+void defaultConfig(configType *config){
+    config->traceAll = 1;
+    config->traceEvery = 0;
+    config->traceFirst = 0;
+    config->traceLast = 0;
+    config->instrWords = 0;
+    config->dataWords = 0;
+    config->bpType = BP_BIMODAL;
+    config->bpEntries = BPENTRIES;
+    config->btbEntries = BTBENTRIES;
+    config->fastForward = 0;
+    config->functional = 0;
+    config->sampleUnit = 0;
+    config->sampleWarm = 0;
+    config->sampleSkip = 0;
+    config->manifest = NULL;
+    config->threads = 0;
+    config->saveFile = NULL;
+    config->saveAt = 0;
+    config->restoreFile = NULL;
+    config->imageFile = NULL;
+    memset(config->cache, 0, sizeof(config->cache));
+    config->memLatency = MEMLATENCY;
+    config->replacement = REPL_LRU;
+    config->writeThrough = 0;
+    config->width = 1;
+    config->ooo = 0;
+    config->robSize = ROBSIZE;
+    config->iqSize = IQSIZE;
+    config->lsqSize = LSQSIZE;
+    config->physRegs = PHYSREGS;
+    config->timelineFile = NULL;
+    config->konataFile = NULL;
+    config->statsFile = NULL;
+    config->statsFormat = STATS_JSON;
+    config->statsInterval = 0;
+    config->cpiStack = 0;
+    config->benchSize = 0;
+    config->kernel = -1;
+    config->check = 0;
+    config->cores = 1;
+    config->quantum = QUANTUM;
+    config->coherence = 0;
+    config->lockstep = 0;
+    config->debugFile = NULL;
+}
+
+/*************************************************************/
+/* The parseArgs function updates the configuration from the */
+/* options in argv[1] onwards. -q, -t and -w replace tracing */
+/* every cycle with quiet or windowed output. Returns        */
+/* nonzero on a malformed command line.                      */
+/*************************************************************/
+int parseArgs(int argc, char *argv[], configType *config){
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-q") == 0) {
+            config->traceAll = 0;
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            config->traceAll = 0;
+            config->traceEvery = atoi(argv[++i]);
+            if (config->traceEvery <= 0)
+                return(1);
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            config->traceAll = 0;
+            if (sscanf(argv[++i], "%d:%d", &config->traceFirst, &config->traceLast) != 2
+                || config->traceFirst <= 0 || config->traceLast < config->traceFirst)
+                return(1);
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            if ((config->instrWords = parseSize(argv[++i])) <= 0)
+                return(1);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            if ((config->dataWords = parseSize(argv[++i])) <= 0)
+                return(1);
+        } else if (strcmp(argv[i], "-bp") == 0 && i + 1 < argc) {
+            char *type = argv[++i];
+            char *entries = strchr(type, ':');
+            int len = entries ? (int)(entries - type) : (int)strlen(type);
+            if (strncmp(type, "nottaken", len) == 0 && len == 8)
+                config->bpType = BP_NOTTAKEN;
+            else if (strncmp(type, "bimodal", len) == 0 && len == 7)
+                config->bpType = BP_BIMODAL;
+            else if (strncmp(type, "gshare", len) == 0 && len == 6)
+                config->bpType = BP_GSHARE;
+            else if (strncmp(type, "tournament", len) == 0 && len == 10)
+                config->bpType = BP_TOURNAMENT;
+            else
+                return(1);
+            if (entries && !isPowerOfTwo(config->bpEntries = atoi(entries + 1)))
+                return(1);
+        } else if (strcmp(argv[i], "-btb") == 0 && i + 1 < argc) {
+            if (!isPowerOfTwo(config->btbEntries = atoi(argv[++i])))
+                return(1);
+        } else if (strcmp(argv[i], "-ff") == 0 && i + 1 < argc) {
+            if ((config->fastForward = atoll(argv[++i])) < 0)
+                return(1);
+        } else if (strcmp(argv[i], "-f") == 0) {
+            config->functional = 1;
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            long long period;
+            if (sscanf(argv[++i], "%lld:%lld:%lld", &config->sampleUnit, &config->sampleWarm, &period) != 3
+                || config->sampleUnit <= 0 || config->sampleWarm < 0
+                || period < config->sampleUnit + config->sampleWarm)
+                return(1);
+            config->sampleSkip = period - config->sampleUnit - config->sampleWarm;
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            config->manifest = argv[++i];
+        } else if (strcmp(argv[i], "-save") == 0 && i + 1 < argc) {
+            char *file = strchr(argv[++i], ':');
+            if (file == NULL || file[1] == '\0' || (config->saveAt = atoll(argv[i])) < 0)
+                return(1);
+            config->saveFile = file + 1;
+        } else if (strcmp(argv[i], "-restore") == 0 && i + 1 < argc) {
+            config->restoreFile = argv[++i];
+        } else if (strcmp(argv[i], "-ic") == 0 && i + 1 < argc) {
+            if (parseCache(argv[++i], &config->cache[CACHE_L1I], 0) != 0)
+                return(1);
+        } else if (strcmp(argv[i], "-dc") == 0 && i + 1 < argc) {
+            if (parseCache(argv[++i], &config->cache[CACHE_L1D], 0) != 0)
+                return(1);
+        } else if (strcmp(argv[i], "-l2") == 0 && i + 1 < argc) {
+            if (parseCache(argv[++i], &config->cache[CACHE_L2], 1) != 0)
+                return(1);
+        } else if (strcmp(argv[i], "-mem") == 0 && i + 1 < argc) {
+            if ((config->memLatency = atoi(argv[++i])) < 0)
+                return(1);
+        } else if (strcmp(argv[i], "-repl") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "lru") == 0)
+                config->replacement = REPL_LRU;
+            else if (strcmp(argv[i], "fifo") == 0)
+                config->replacement = REPL_FIFO;
+            else if (strcmp(argv[i], "random") == 0)
+                config->replacement = REPL_RANDOM;
+            else
+                return(1);
+        } else if (strcmp(argv[i], "-wt") == 0) {
+            config->writeThrough = 1;
+        } else if (strcmp(argv[i], "-width") == 0 && i + 1 < argc) {
+            config->width = atoi(argv[++i]);
+            if (config->width < 1 || config->width > MAXWIDTH)
+                return(1);
+        } else if (strcmp(argv[i], "-ooo") == 0) {
+            config->ooo = 1;
+        } else if (strcmp(argv[i], "-rob") == 0 && i + 1 < argc) {
+            if ((config->robSize = atoi(argv[++i])) <= 0)
+                return(1);
+        } else if (strcmp(argv[i], "-iq") == 0 && i + 1 < argc) {
+            if ((config->iqSize = atoi(argv[++i])) <= 0)
+                return(1);
+        } else if (strcmp(argv[i], "-lsq") == 0 && i + 1 < argc) {
+            if ((config->lsqSize = atoi(argv[++i])) <= 0)
+                return(1);
+        } else if (strcmp(argv[i], "-pregs") == 0 && i + 1 < argc) {
+            if ((config->physRegs = atoi(argv[++i])) <= 0)
+                return(1);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            config->imageFile = argv[++i];
+        } else if (strcmp(argv[i], "-timeline") == 0 && i + 1 < argc) {
+            config->timelineFile = argv[++i];
+        } else if (strcmp(argv[i], "-konata") == 0 && i + 1 < argc) {
+            config->konataFile = argv[++i];
+        } else if ((strcmp(argv[i], "-json") == 0 || strcmp(argv[i], "-csv") == 0) && i + 1 < argc) {
+            config->statsFormat = strcmp(argv[i], "-csv") == 0 ? STATS_CSV : STATS_JSON;
+            config->statsFile = argv[++i];
+        } else if (strcmp(argv[i], "-interval") == 0 && i + 1 < argc) {
+            if ((config->statsInterval = atoll(argv[++i])) <= 0)
+                return(1);
+        } else if (strcmp(argv[i], "-cpi") == 0) {
+            config->cpiStack = 1;
+        } else if (strcmp(argv[i], "-cores") == 0 && i + 1 < argc) {
+            config->cores = atoi(argv[++i]);
+            if (config->cores < 1 || config->cores > MAXCORES)
+                return(1);
+        } else if (strcmp(argv[i], "-quantum") == 0 && i + 1 < argc) {
+            if ((config->quantum = atoi(argv[++i])) <= 0)
+                return(1);
+        } else if (strcmp(argv[i], "-coherent") == 0) {
+            config->coherence = 1;
+        } else if (strcmp(argv[i], "-check") == 0) {
+            config->check = 1;
+        } else if (strcmp(argv[i], "-bench") == 0 && i + 1 < argc) {
+            config->benchSize = atoi(argv[++i]);
+            if (config->benchSize <= 0 || config->benchSize > KERNELMAX)
+                return(1);
+        } else if (strcmp(argv[i], "-kernel") == 0 && i + 1 < argc) {
+            char *size = strchr(argv[++i], ':');
+            int len = size ? (int)(size - argv[i]) : 0;
+            for (config->kernel = NUMKERNELS - 1; config->kernel >= 0; config->kernel--)
+                if (strncmp(argv[i], kernelNames[config->kernel], len) == 0
+                    && kernelNames[config->kernel][len] == '\0')
+                    break;
+            if (size == NULL || config->kernel < 0
+                || (config->benchSize = atoi(size + 1)) <= 0 || config->benchSize > KERNELMAX)
+                return(1);
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            if ((config->threads = atoi(argv[++i])) <= 0)
+                return(1);
+        } else if (strcmp(argv[i], "-lockstep") == 0) {
+            config->lockstep = 1;
+        } else if (strcmp(argv[i], "-debug") == 0 && i + 1 < argc) {
+            config->debugFile = argv[++i];
+        } else {
+            return(1);
+        }
+    }
+    return(0);
+}
+
+int isPowerOfTwo(int n){
+    return(n > 0 && (n & (n - 1)) == 0);
+}
+
+/*************************************************************/
+/* The parseSize function converts a memory size in bytes,   */
+/* with an optional K, M or G suffix, into a number of       */
+/* words, rounding up. Returns -1 if the size is malformed   */
+/* or too large to index with an int.                        */
+/*************************************************************/
+int parseSize(char *str){
+    char *end;
+    long long bytes = strtoll(str, &end, 10);
+
+    switch (*end) {
+        case 'G': case 'g': bytes <<= 10; /* fall through */
+        case 'M': case 'm': bytes <<= 10; /* fall through */
+        case 'K': case 'k': bytes <<= 10; end++; break;
+    }
+    if (*end != '\0' || bytes <= 0 || (bytes + 3) / 4 > 0x7FFFFFFF)
+        return(-1);
+    return((int)((bytes + 3) / 4));
+}
+
+/*************************************************************/
+/* The parseCache function reads a cache geometry given as   */
+/* SIZE:WAYS:LINE, followed by :LATENCY if withLatency is    */
+/* nonzero. The size, the line size and the resulting number */
+/* of sets must be powers of two. Returns nonzero if the     */
+/* geometry is malformed.                                    */
+/*************************************************************/
+int parseCache(char *str, cacheConfigType *cache, int withLatency){
+    char size[32];
+    int fields;
+
+    cache->latency = 0;
+    fields = sscanf(str, "%31[^:]:%d:%d:%d", size, &cache->ways, &cache->line, &cache->latency);
+    if (fields != (withLatency ? 4 : 3) || parseSize(size) <= 0 || parseSize(size) > 0x7FFFFFFF / 4)
+        return(1);
+    cache->size = 4 * parseSize(size);
+    if (!isPowerOfTwo(cache->size) || !isPowerOfTwo(cache->line) || cache->line < 4
+        || cache->ways <= 0 || cache->size % (cache->ways * cache->line) != 0
+        || !isPowerOfTwo(cache->size / (cache->ways * cache->line)) || cache->latency < 0)
+        return(1);
+    return(0);
+}
+
+/*************************************************************/
+/* The allocMemory function returns bytes of zeroed memory,  */
+/* or NULL if it cannot be mapped. The pages are mapped on   */
+/* demand, so a large data memory only costs what the        */
+/* program actually touches.                                 */
+/*************************************************************/
+void *allocMemory(size_t bytes){
+    void *mem;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+#ifdef MAP_NORESERVE
+    flags |= MAP_NORESERVE;
+#endif
+    mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (mem == MAP_FAILED) {
+        fprintf(stderr, "error: cannot allocate %zu bytes of memory\n", bytes);
+        return(NULL);
+    }
+    return(mem);
+}
+
+void freeMemory(void *mem, size_t bytes){
+    if (mem != NULL)
+        munmap(mem, bytes);
+}
+
+/*************************************************************/
+/* The checkDataAddr function returns nonzero, and marks the */
+/* state as faulted, if a load or store address falls        */
+/* outside of data memory. The simulation then stops.        */
+/*************************************************************/
+int checkDataAddr(stateType *statePtr, int addr){
+    if (addr < 0 || addr / 4 >= statePtr->numDataMem) {
+        fprintf(stderr, "error: data address %d out of range (%d words) in cycle %lld\n",
+            addr, statePtr->numDataMem, statePtr->cycles + 1);
+        statePtr->fault = 1;
+        return(1);
+    }
+    return(0);
+}
 
-int main(){
-    run();
-    return(0); 
+/*************************************************************/
+/* The traceCycle function returns nonzero if the state and  */
+/* the stall/forwarding messages should be printed for the   */
+/* given cycle (numbered from 1, as printState does).        */
+/*************************************************************/
+int traceCycle(configType *config, long long cycle){
+    if (config->traceAll)
+        return(1);
+    if (config->traceEvery && (cycle - 1) % config->traceEvery == 0)
+        return(1);
+    return(config->traceFirst && cycle >= config->traceFirst && cycle <= config->traceLast);
 }
 
 int get_rs(unsigned int instruction){
@@ -95,375 +1445,5325 @@ int get_funct(unsigned int instruction){
 }
 
 int get_immed(unsigned int instruction){
-    return(instruction & 0xFFFF);
+    return((short)(instruction & 0xFFFF));
 }
 
 int get_opcode(unsigned int instruction){
     return(instruction>>26);
 }
 
-void run(){
-
-  stateType state;           /* Contains the state of the entire pipeline before the cycle executes */ 
-  stateType newState;        /* Contains the state of the entire pipeline after the cycle executes */
-  initState(&state);         /* Initialize the state of the pipeline */
-	int numStalls = 0;//count number of stalls needed throughout program
-	int numBranches = 0;
-	int numMisPred = 0;
-    
-    while (1) {
-
-        printState(&state);
-
-	/* If a halt instruction is entering its WB stage, then all of the legitimate */
-	/* instruction have completed. Print the statistics and exit the program. */
-        if (get_opcode(state.MEMWB.instr) == HALT) {
-            printf("Total number of cycles executed: %d\n", state.cycles);
-            printf("Total number of stalls: %d\n", numStalls);
-            printf("Total number of branches: %d\n", numBranches);
-            printf("Total number of mispredicted branches: %d\n", numMisPred);
-            /* Remember to print the number of stalls, branches, and mispredictions! */
-            exit(0);
-        }
-
-        newState = state;     /* Start by making newState a copy of the state before the cycle */
-        newState.cycles++;
+/*************************************************************/
+/* The decodeInstr function decodes an instruction once, so  */
+/* that the pipeline stages can switch on a dense operation  */
+/* value and read register numbers and the sign-extended     */
+/* immediate without extracting bit fields every cycle.      */
+/* Unknown instructions decode to NOOPs.                     */
+/*************************************************************/
+void decodeInstr(unsigned int instr, decodedType *dec){
+    memset(dec, 0, sizeof(*dec));
+    dec->instr = instr;
+    dec->rs = get_rs(instr);
+    dec->rt = get_rt(instr);
+    dec->immed = get_immed(instr);
+    switch (get_opcode(instr)) {
+        case R:
+            dec->rd = get_rd(instr);
+            if (get_funct(instr) == ADD)
+                dec->op = OP_ADD;
+            else if (get_funct(instr) == SUB)
+                dec->op = OP_SUB;
+            break;
+        case LW:   dec->op = OP_LW;   break;
+        case SW:   dec->op = OP_SW;   break;
+        case BNE:  dec->op = OP_BNE;  break;
+        case HALT: dec->op = OP_HALT; break;
+    }
+}
 
-	/* Modify newState stage-by-stage below to reflect the state of the pipeline after the cycle has executed */
+int run(configType *config){
+    programType program;
+    resultType result;
+    int status;
+
+    if (config->restoreFile != NULL)
+        memset(&program, 0, sizeof(program));
+    else if (loadProgram(stdin, "<stdin>", &program) != 0)
+        return(1);
+    if (config->imageFile != NULL) {
+        if ((status = saveImage(&program, config->imageFile)) != 0)
+            fprintf(stderr, "error: cannot write program image %s\n", config->imageFile);
+        freeProgram(&program);
+        return(status);
+    }
+    status = simulate(config, &program, &result);
+    freeProgram(&program);
+    if (status == 0)
+        printResult(config, &result);
+    return(status);
+}
 
-        /* --------------------- IF stage --------------------- */
+/*************************************************************/
+/* The simulate function runs one program with one           */
+/* configuration and fills in the result. It keeps no state  */
+/* outside of its arguments, so several simulations can run  */
+/* at once on different threads (with tracing off). Returns  */
+/* nonzero if the simulation could not be set up or a load   */
+/* or store faulted.                                         */
+/*************************************************************/
+int simulate(configType *config, programType *program, resultType *result){
 
-        newState.PC = ((state.PC) + 4);//set newState's PC to oldState's PC plus 4 for next instr 
-        
-        newState.IFID.instr = state.instrMem[((state.PC) / 4)];//PC divide by 4 since data memory is sequential
-        
-        newState.IFID.PCPlus4 = ((state.PC) + 4);
+  simType sim;               /* State of the simulated machine */
+  int status;
+  int i;
 
-        /* --------------------- ID stage --------------------- */   
+    if (config->debugFile != NULL && (config->cores > 1 || config->ooo || config->functional || config->sampleUnit > 0)) {
+        fprintf(stderr, "error: -debug records the in-order pipeline of one core, without -f or -s\n");
+        return(1);
+    }
+    if (config->cores > 1)
+        return(simulateCores(config, program, result));
+
+    memset(result, 0, sizeof(*result));
+    sim.config = config;
+    memset(&sim.stats, 0, sizeof(sim.stats));
+    initPredictor(&sim.pred, config);
+    initCaches(sim.cache, config);
+    sim.ooo = NULL;
+    sim.timeline = NULL;
+    sim.statsOut = NULL;
+    sim.statsDumps = 0;
+    sim.checker = NULL;
+    sim.tracer = NULL;
+    sim.written = NULL;
+    sim.pipeline = NULL;
+    sim.nextLane = NULL;
+    sim.lockstep = NULL;
+    sim.history = NULL;
+    if (config->ooo) {
+        sim.ooo = malloc(sizeof(oooType));
+        initOoO(sim.ooo, config);
+    }
+    if (config->restoreFile != NULL && config->ooo) {
+        fprintf(stderr, "error: checkpoints cannot be restored into the out-of-order model\n");
+        status = 1;
+    } else if (config->restoreFile != NULL) {
+        status = restoreCheckpoint(&sim, config->restoreFile);
+    } else {
+        status = initState(&sim.state, config, program); /* Initialize the state of the pipeline */
+    }
+    if (status == 0 && config->check && initChecker(&sim) != 0) {
+        freeState(&sim.state);
+        status = 1;
+    }
+    if (status == 0 && config->timelineFile != NULL
+        && (sim.timeline = openTimeline(config->timelineFile, &sim.state)) == NULL) {
+        fprintf(stderr, "error: cannot create timeline %s\n", config->timelineFile);
+        freeState(&sim.state);
+        status = 1;
+    }
+    if (status == 0 && config->statsFile != NULL && (sim.statsOut = fopen(config->statsFile, "w")) == NULL) {
+        fprintf(stderr, "error: cannot create %s\n", config->statsFile);
+        if (sim.timeline != NULL)
+            closeTimeline(sim.timeline);
+        freeState(&sim.state);
+        status = 1;
+    }
+    if (status == 0 && (config->traceAll || config->traceEvery || config->traceFirst)
+        && (sim.tracer = startTrace(&sim.state)) == NULL) {
+        fprintf(stderr, "error: cannot start the trace writer\n");
+        if (sim.statsOut != NULL)
+            fclose(sim.statsOut);
+        if (sim.timeline != NULL)
+            closeTimeline(sim.timeline);
+        freeState(&sim.state);
+        status = 1;
+    }
+    if (status == 0 && config->debugFile != NULL && (sim.history = startHistory(config->debugFile)) == NULL) {
+        fprintf(stderr, "error: cannot open debugger commands %s\n", config->debugFile);
+        if (sim.tracer != NULL)
+            stopTrace(sim.tracer);
+        if (sim.statsOut != NULL)
+            fclose(sim.statsOut);
+        if (sim.timeline != NULL)
+            closeTimeline(sim.timeline);
+        freeState(&sim.state);
+        status = 1;
+    }
+    if (status != 0) {
+        freeChecker(sim.checker);
+        freePredictor(&sim.pred);
+        freeCaches(sim.cache);
+        if (sim.ooo != NULL)
+            freeOoO(sim.ooo);
+        free(sim.ooo);
+        return(1);
+    }
 
-        int memRead = 0;
+    /* Functional execution leaves PC, regFile and dataMem as if the instructions */
+    /* had retired, with an empty pipeline, so the pipeline model can start there */
+    if (config->functional || config->fastForward > 0) {
+        result->fastForwarded = runFunctional(&sim.state, config->functional ? -1 : config->fastForward);
+        if (sim.checker != NULL)
+            skipChecker(&sim, result->fastForwarded);
+        if (config->functional && sim.tracer != NULL)
+            traceState(&sim);
+    }
 
-        if(get_opcode(state.IDEX.instr) == LW) {
+    if (config->functional || sim.state.fault) {
+        /* Nothing left to simulate */
+    } else if (config->sampleUnit > 0) {
+        runSampled(&sim, result);
+    } else {
+        do {
+            if (sim.history != NULL)
+                recordHistory(&sim);
+            if (config->saveFile != NULL && sim.state.cycles == config->saveAt
+                && saveCheckpoint(&sim, config->saveFile) != 0)
+                fprintf(stderr, "error: cannot write checkpoint %s\n", config->saveFile);
+            if (sim.statsOut != NULL && config->statsInterval > 0 && sim.state.cycles > 0
+                && sim.state.cycles % config->statsInterval == 0)
+                dumpStats(&sim);
+        } while (!cycle(&sim, 1));
+        if (sim.history != NULL)
+            recordHistory(&sim);
+    }
 
-        	memRead = 1;
+    if (sim.tracer != NULL)
+        stopTrace(sim.tracer);
+    if (sim.history != NULL) {
+        runDebugger(&sim);
+        freeHistory(sim.history);
+    }
+    if (sim.checker != NULL) {
+        finishChecker(&sim);
+        result->checked = sim.checker->checked;
+        freeChecker(sim.checker);
+    }
+    result->stats = sim.stats;
+    result->cycles = sim.state.cycles;
+    if (config->sampleUnit == 0)
+        result->instructions = result->fastForwarded + sim.stats.instructions;
+    result->fault = sim.state.fault;
+    for (i = 0; i < NUMCACHES; i++)
+        result->cache[i] = sim.cache[i].stats;
+    if (sim.timeline != NULL && closeTimeline(sim.timeline) != 0)
+        fprintf(stderr, "error: cannot write timeline %s\n", config->timelineFile);
+    if (sim.statsOut != NULL) {
+        dumpStats(&sim);
+        if (fclose(sim.statsOut) != 0)
+            fprintf(stderr, "error: cannot write %s\n", config->statsFile);
+    }
+    freeState(&sim.state);
+    freePredictor(&sim.pred);
+    freeCaches(sim.cache);
+    if (sim.ooo != NULL)
+        freeOoO(sim.ooo);
+    free(sim.ooo);
+    return(result->fault);
+}
 
+/*************************************************************/
+/* The simulateCores function is simulate for several cores. */
+/* Every core has its own pipeline, PC, registers, branch    */
+/* predictor and caches, and they all run the program on one */
+/* shared instruction and data memory, core i starting with  */
+/* its number in register COREREG. The cores are dealt out   */
+/* to host threads, which run each of their cores for a      */
+/* quantum of cycles and then meet at a barrier, where the   */
+/* last thread to arrive delivers the coherence              */
+/* invalidations of the quantum. Stores reach the shared     */
+/* memory at once (see LOADDATA), so cores on different      */
+/* threads that race on a word within a quantum see each     */
+/* other's stores in host order; with one thread the result  */
+/* is deterministic.                                         */
+/* The run ends when every core has halted, or any faulted.  */
+/*************************************************************/
+int simulateCores(configType *config, programType *program, resultType *result){
+    configType coreConfig = *config;
+    multiType multi;
+    coreWorkerType *workers;
+    pthread_t *threads;
+    simType *sim;
+    int c, i;
+
+    memset(result, 0, sizeof(*result));
+    if (config->restoreFile != NULL || config->saveFile != NULL || config->sampleUnit > 0
+        || config->functional || config->fastForward > 0 || config->timelineFile != NULL
+        || config->statsFile != NULL || config->check) {
+        fprintf(stderr, "error: several cores cannot be combined with checkpoints, sampling, functional\n"
+            "\texecution, timelines, counter export or -check\n");
+        return(1);
+    }
+    coreConfig.traceAll = coreConfig.traceEvery = coreConfig.traceFirst = 0;
+
+    memset(&multi, 0, sizeof(multi));
+    multi.numCores = config->cores;
+    multi.cores = calloc(multi.numCores, sizeof(simType));
+    multi.halted = calloc(multi.numCores, sizeof(int));
+    if (initState(&multi.cores[0].state, &coreConfig, program) != 0) {
+        free(multi.cores);
+        free(multi.halted);
+        return(1);
+    }
+    for (c = 0; c < multi.numCores; c++) {
+        sim = &multi.cores[c];
+        sim->config = &coreConfig;
+        if (c > 0)
+            sim->state = multi.cores[0].state;
+        sim->state.regFile[COREREG] = c;
+        initPredictor(&sim->pred, &coreConfig);
+        initCaches(sim->cache, &coreConfig);
+        if (config->ooo) {
+            sim->ooo = malloc(sizeof(oooType));
+            initOoO(sim->ooo, &coreConfig);
         }
+        if (config->coherence && sim->cache[CACHE_L1D].tags != NULL) {
+            sim->capWritten = 64;
+            sim->written = malloc(sizeof(unsigned int) * sim->capWritten);
+        }
+    }
 
-        if((memRead  != 0) && ((state.IDEX.rtReg == get_rs(state.IFID.instr)) || (state.IDEX.rtReg == get_rt(state.IFID.instr)))) {
-
-        	printf("\nStall Pipeline\n");
+    multi.numThreads = config->threads ? config->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (multi.numThreads > multi.numCores)
+        multi.numThreads = multi.numCores;
+    if (multi.numThreads < 1)
+        multi.numThreads = 1;
+    multi.quantum = config->quantum;
+    multi.quantumEnd = config->quantum;
+    pthread_mutex_init(&multi.barrier.lock, NULL);
+    pthread_cond_init(&multi.barrier.open, NULL);
+    multi.barrier.count = multi.numThreads;
+
+    workers = malloc(sizeof(coreWorkerType) * multi.numThreads);
+    threads = malloc(sizeof(pthread_t) * multi.numThreads);
+    for (i = 0; i < multi.numThreads; i++) {
+        workers[i].multi = &multi;
+        workers[i].id = i;
+        pthread_create(&threads[i], NULL, coreWorker, &workers[i]);
+    }
+    for (i = 0; i < multi.numThreads; i++)
+        pthread_join(threads[i], NULL);
+
+    /* Add up the cores; the machine ran as long as its slowest core */
+    result->cores = multi.numCores;
+    for (c = 0; c < multi.numCores; c++) {
+        sim = &multi.cores[c];
+        for (i = 0; i < (int)NUMCOUNTERS; i++)
+            COUNTER(&result->stats, i) += COUNTER(&sim->stats, i);
+        for (i = 0; i < NUMCACHES; i++) {
+            result->cache[i].hits += sim->cache[i].stats.hits;
+            result->cache[i].misses += sim->cache[i].stats.misses;
+            result->cache[i].evictions += sim->cache[i].stats.evictions;
+            result->cache[i].writebacks += sim->cache[i].stats.writebacks;
+        }
+        if (sim->state.cycles > result->cycles)
+            result->cycles = sim->state.cycles;
+        result->coreCycles[c] = sim->state.cycles;
+        result->coreInstructions[c] = sim->stats.instructions;
+        result->fault |= sim->state.fault;
+    }
+    result->instructions = result->stats.instructions;
+
+    pthread_mutex_destroy(&multi.barrier.lock);
+    pthread_cond_destroy(&multi.barrier.open);
+    for (c = 0; c < multi.numCores; c++) {
+        sim = &multi.cores[c];
+        freePredictor(&sim->pred);
+        freeCaches(sim->cache);
+        if (sim->ooo != NULL)
+            freeOoO(sim->ooo);
+        free(sim->ooo);
+        free(sim->written);
+    }
+    freeState(&multi.cores[0].state);
+    free(multi.cores);
+    free(multi.halted);
+    free(workers);
+    free(threads);
+    return(result->fault);
+}
 
-            newState.IDEX.instr = 0; //flush cycle
+/*************************************************************/
+/* The coreWorker function is the body of a thread that      */
+/* simulates cores id, id + numThreads, and so on, one       */
+/* quantum at a time.                                        */
+/*************************************************************/
+void *coreWorker(void *arg){
+    coreWorkerType *worker = arg;
+    multiType *multi = worker->multi;
+    simType *sim;
+    int c;
+
+    while (!multi->done) {
+        for (c = worker->id; c < multi->numCores; c += multi->numThreads) {
+            sim = &multi->cores[c];
+            while (!multi->halted[c] && sim->state.cycles < multi->quantumEnd)
+                if (cycle(sim, 1))
+                    multi->halted[c] = 1;
+        }
+        if (waitBarrier(&multi->barrier))
+            syncCores(multi);
+        waitBarrier(&multi->barrier);
+    }
+    return(NULL);
+}
 
-                newState.IFID.instr = state.IFID.instr;
+/*************************************************************/
+/* The syncCores function runs between quanta, while every   */
+/* other thread waits. Each line a core stored to is dropped */
+/* from the other cores' data caches (L1 and L2, which are   */
+/* private), so their next access to it misses. Then the     */
+/* next quantum starts, unless the run is over.              */
+/*************************************************************/
+void syncCores(multiType *multi){
+    simType *sim, *other;
+    int running = 0, fault = 0;
+    int c, o, i, found;
+
+    for (c = 0; c < multi->numCores; c++) {
+        sim = &multi->cores[c];
+        running += !multi->halted[c];
+        fault |= sim->state.fault;
+        for (i = 0; i < sim->numWritten; i++) {
+            for (o = 0; o < multi->numCores; o++) {
+                if (o == c)
+                    continue;
+                other = &multi->cores[o];
+                found = cacheInvalidate(&other->cache[CACHE_L1D], sim->written[i]);
+                if (other->cache[CACHE_L2].tags != NULL)
+                    found |= cacheInvalidate(&other->cache[CACHE_L2], sim->written[i]);
+                other->stats.numInvalidations += found;
+            }
+        }
+        sim->numWritten = 0;
+    }
+    multi->quantumEnd += multi->quantum;
+    multi->done = (running == 0 || fault);
+}
 
-                newState.IFID.PCPlus4 = state.IFID.PCPlus4;\
+/* Wait until every thread has reached the barrier. Returns nonzero */
+/* in the last thread to arrive.                                    */
+int waitBarrier(barrierType *barrier){
+    unsigned int generation;
+    int last = 0;
+
+    pthread_mutex_lock(&barrier->lock);
+    generation = barrier->generation;
+    if (++barrier->waiting == barrier->count) {
+        barrier->waiting = 0;
+        barrier->generation++;
+        pthread_cond_broadcast(&barrier->open);
+        last = 1;
+    } else {
+        while (generation == barrier->generation)
+            pthread_cond_wait(&barrier->open, &barrier->lock);
+    }
+    pthread_mutex_unlock(&barrier->lock);
+    return(last);
+}
 
-                newState.PC = state.PC;
+/* Note a store to addr for the other cores' caches. Repeated */
+/* stores to the same line are noted once.                    */
+void logWrite(simType *sim, int addr){
+    unsigned int line = (unsigned int)addr >> sim->cache[CACHE_L1D].lineShift << sim->cache[CACHE_L1D].lineShift;
 
-            numStalls++;
+    if (sim->numWritten > 0 && sim->written[sim->numWritten - 1] == line)
+        return;
+    if (sim->numWritten == sim->capWritten) {
+        sim->capWritten *= 2;
+        sim->written = realloc(sim->written, sizeof(unsigned int) * sim->capWritten);
+    }
+    sim->written[sim->numWritten++] = line;
+}
 
-        } else {
+/*************************************************************/
+/* The printResult function prints the statistics at the end */
+/* of a single run.                                          */
+/*************************************************************/
+void printResult(configType *config, resultType *result){
+    static const char *names[] = {"CPI", "stalls per instruction", "misprediction rate"};
+    static const char *cacheNames[NUMCACHES] = {"L1I", "L1D", "L2"};
+    static const char *cpiNames[NUMCPI] = {"base", "hazard", "branch", "memory"};
+    int i;
 
-                newState.IDEX.instr = state.IFID.instr; 
-                
+    if (config->check)
+        printf("Instructions checked against the reference model: %lld\n", result->checked);
+    if (config->functional) {
+        printf("Total number of instructions executed: %lld\n", result->instructions);
+        return;
+    }
+    if (config->fastForward > 0)
+        printf("Total number of instructions fast-forwarded: %lld\n", result->fastForwarded);
+    if (config->sampleUnit > 0) {
+        printf("Sampled %d units of %lld instructions (%lld warm-up) every %lld instructions\n",
+            result->samples, config->sampleUnit, config->sampleWarm,
+            config->sampleUnit + config->sampleWarm + config->sampleSkip);
+        printf("Total number of instructions executed: %lld\n", result->instructions);
+        printf("Detailed cycles simulated: %lld\n", result->cycles);
+        for (i = 0; i < 3; i++) {
+            printf("Estimated %s: %.4f +/- %.4f (95%% confidence)\n",
+                names[i], result->estimate[i], result->confidence[i]);
+            if (i == 0)
+                printf("Estimated total number of cycles: %.0f\n",
+                    result->estimate[0] * result->instructions);
         }
+        return;
+    }
+    printf("Total number of cycles executed: %lld\n", result->cycles);
+    printf("Total number of stalls: %lld\n", result->stats.numStalls);
+    printf("Total number of branches: %lld\n", result->stats.numBranches);
+    printf("Total number of mispredicted branches: %lld\n", result->stats.numMisPred);
+    if (config->width > 1 || config->ooo || result->cores > 1)
+        printf("Instructions per cycle: %.4f\n", result->cycles ? (double)result->stats.instructions / result->cycles : 0.0);
+    if (config->ooo) {
+        printf("Total number of dispatch stalls on a full reorder buffer: %lld\n", result->stats.numRobFull);
+        printf("Total number of dispatch stalls on a full issue queue: %lld\n", result->stats.numIqFull);
+        printf("Total number of dispatch stalls on a full load/store queue: %lld\n", result->stats.numLsqFull);
+        printf("Total number of dispatch stalls for rename registers: %lld\n", result->stats.numRegsFull);
+    } else if (config->width > 1) {
+        printf("Total number of issue groups split by dependences: %lld\n", result->stats.numDepSplits);
+        printf("Total number of issue groups split by the memory port: %lld\n", result->stats.numPortSplits);
+    }
+    if (config->cache[CACHE_L1I].size > 0)
+        printf("Total number of fetch stall cycles: %lld\n", result->stats.numFetchStalls);
+    if (config->cache[CACHE_L1D].size > 0)
+        printf("Total number of memory stall cycles: %lld\n", result->stats.numMemStalls);
+    for (i = 0; i < NUMCACHES; i++) {
+        cacheStatsType *cache = &result->cache[i];
+        if (config->cache[i].size == 0)
+            continue;
+        printf("%s cache: %lld hits, %lld misses (%.2f%%), %lld evictions, %lld writebacks\n",
+            cacheNames[i], cache->hits, cache->misses,
+            cache->hits + cache->misses ? 100.0 * cache->misses / (cache->hits + cache->misses) : 0.0,
+            cache->evictions, cache->writebacks);
+    }
+    if (result->cores > 1) {
+        for (i = 0; i < result->cores; i++)
+            printf("Core %d: %lld instructions in %lld cycles\n", i, result->coreInstructions[i], result->coreCycles[i]);
+        if (config->coherence)
+            printf("Total number of cache lines invalidated by coherence: %lld\n", result->stats.numInvalidations);
+    }
+    if (config->cpiStack) {
+        long long slots = 0;
+        for (i = 0; i < NUMCPI; i++)
+            slots += result->stats.cpiSlots[i];
+        printf("CPI stack (cycles per instruction by cause):\n");
+        for (i = 0; i < NUMCPI; i++)
+            printf("\t%-7s %.4f (%.1f%%)\n", cpiNames[i],
+                result->stats.instructions ? (double)result->stats.cpiSlots[i] / config->width / result->stats.instructions : 0.0,
+                slots ? 100.0 * result->stats.cpiSlots[i] / slots : 0.0);
+    }
+}
 
-        if(get_opcode(newState.EXMEM.instr) != HALT) {
-        
-        	newState.IDEX.PCPlus4 = state.IFID.PCPlus4;  
-
-        	newState.IDEX.readData1 = newState.regFile[get_rs(newState.IDEX.instr)];
-                       
-        	newState.IDEX.readData2 = newState.regFile[get_rt(newState.IDEX.instr)];
+/*************************************************************/
+/* The dumpStats function exports every counter in           */
+/* counterTable, the cache counters and the CPI stack (each  */
+/* category's retirement slots divided by width and by the   */
+/* instructions retired, so they add up to the CPI) as of    */
+/* the current cycle, as one line of sim->statsOut. A CSV    */
+/* file gets a header line first.                            */
+/*************************************************************/
+void dumpStats(simType *sim)
+{
+    static const char *cacheNames[NUMCACHES] = {"l1i", "l1d", "l2"};
+    static const char *cpiNames[NUMCPI] = {"base", "hazard", "branch", "memory"};
+    int format = sim->config->statsFormat;
+    double scale = sim->stats.instructions ? 1.0 / ((double)sim->config->width * sim->stats.instructions) : 0.0;
+    char name[32], value[32];
+    int header, n, c;
+    size_t i;
+
+    for (header = (format == STATS_CSV && sim->statsDumps == 0); header >= 0; header--) {
+        n = 0;
+        snprintf(value, sizeof(value), "%lld", sim->state.cycles);
+        writeStat(sim->statsOut, format, header, n++, "cycles", value);
+        for (i = 0; i < NUMCOUNTERS; i++) {
+            snprintf(value, sizeof(value), "%lld", COUNTER(&sim->stats, i));
+            writeStat(sim->statsOut, format, header, n++, counterTable[i].name, value);
+        }
+        for (c = 0; c < NUMCACHES; c++) {
+            cacheStatsType *stats = &sim->cache[c].stats;
+            snprintf(name, sizeof(name), "%s_hits", cacheNames[c]);
+            snprintf(value, sizeof(value), "%lld", stats->hits);
+            writeStat(sim->statsOut, format, header, n++, name, value);
+            snprintf(name, sizeof(name), "%s_misses", cacheNames[c]);
+            snprintf(value, sizeof(value), "%lld", stats->misses);
+            writeStat(sim->statsOut, format, header, n++, name, value);
+            snprintf(name, sizeof(name), "%s_evictions", cacheNames[c]);
+            snprintf(value, sizeof(value), "%lld", stats->evictions);
+            writeStat(sim->statsOut, format, header, n++, name, value);
+            snprintf(name, sizeof(name), "%s_writebacks", cacheNames[c]);
+            snprintf(value, sizeof(value), "%lld", stats->writebacks);
+            writeStat(sim->statsOut, format, header, n++, name, value);
+        }
+        snprintf(value, sizeof(value), "%.6f",
+            sim->stats.instructions ? (double)sim->state.cycles / sim->stats.instructions : 0.0);
+        writeStat(sim->statsOut, format, header, n++, "cpi", value);
+        for (c = 0; c < NUMCPI; c++) {
+            snprintf(name, sizeof(name), "cpi_%s", cpiNames[c]);
+            snprintf(value, sizeof(value), "%.6f", sim->stats.cpiSlots[c] * scale);
+            writeStat(sim->statsOut, format, header, n++, name, value);
+        }
+        fprintf(sim->statsOut, format == STATS_JSON ? "}\n" : "\n");
+    }
+    sim->statsDumps++;
+}
 
-        	newState.IDEX.rsReg = get_rs(newState.IDEX.instr);
-                       
-        	newState.IDEX.rtReg = get_rt(newState.IDEX.instr);
+/*************************************************************/
+/* The writeStat function writes the n'th statistic of a     */
+/* dump: a JSON member, a CSV value, or (if header is set) a */
+/* CSV column name.                                          */
+/*************************************************************/
+void writeStat(FILE *out, int format, int header, int n, const char *name, const char *value)
+{
+    if (format == STATS_JSON)
+        fprintf(out, "%s\"%s\": %s", n ? ", " : "{", name, value);
+    else
+        fprintf(out, "%s%s", n ? "," : "", header ? name : value);
+}
 
-            	if(get_opcode(newState.IDEX.instr) == R) {
+/*************************************************************/
+/* The runBench function runs every benchmark kernel at the  */
+/* size given by -bench, with the other options and tracing  */
+/* off, and prints a line per kernel with its modeled CPI    */
+/* and how fast the simulator ran it: simulated instructions */
+/* and cycles per host second, from the fastest of BENCHREPS */
+/* runs. Returns nonzero if any kernel failed.               */
+/*************************************************************/
+int runBench(configType *config){
+    configType benchConfig = *config;
+    programType program;
+    resultType result;
+    struct timespec start, end;
+    double seconds, best, totalSeconds = 0.0;
+    long long totalInstrs = 0, totalCycles = 0;
+    int kernel, rep, status, failed = 0;
+    FILE *text;
+
+    benchConfig.traceAll = benchConfig.traceEvery = benchConfig.traceFirst = 0;
+    printf("%-8s %12s %12s %8s %10s %10s %10s\n",
+        "kernel", "instructions", "cycles", "CPI", "seconds", "Minstr/s", "Mcycles/s");
+    for (kernel = 0; kernel < NUMKERNELS; kernel++) {
+        if ((text = tmpfile()) == NULL) {
+            fprintf(stderr, "error: cannot create a temporary file\n");
+            return(1);
+        }
+        writeKernel(text, kernel, config->benchSize);
+        rewind(text);
+        status = loadProgram(text, kernelNames[kernel], &program);
+        fclose(text);
+        if (status != 0) {
+            failed = 1;
+            continue;
+        }
+        best = 0.0;
+        for (rep = 0; rep < BENCHREPS && status == 0; rep++) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            status = simulate(&benchConfig, &program, &result);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            seconds = (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+            if (rep == 0 || seconds < best)
+                best = seconds;
+        }
+        freeProgram(&program);
+        if (status != 0) {
+            printf("%-8s error\n", kernelNames[kernel]);
+            failed = 1;
+            continue;
+        }
+        printf("%-8s %12lld %12lld %8.4f %10.4f %10.2f %10.2f\n", kernelNames[kernel],
+            result.instructions, result.cycles,
+            result.instructions ? (double)result.cycles / result.instructions : 0.0,
+            best, best > 0.0 ? 1e-6 * result.instructions / best : 0.0,
+            best > 0.0 ? 1e-6 * result.cycles / best : 0.0);
+        totalInstrs += result.instructions;
+        totalCycles += result.cycles;
+        totalSeconds += best;
+    }
+    printf("%-8s %12lld %12lld %8.4f %10.4f %10.2f %10.2f\n", "total",
+        totalInstrs, totalCycles, totalInstrs ? (double)totalCycles / totalInstrs : 0.0,
+        totalSeconds, totalSeconds > 0.0 ? 1e-6 * totalInstrs / totalSeconds : 0.0,
+        totalSeconds > 0.0 ? 1e-6 * totalCycles / totalSeconds : 0.0);
+    return(failed);
+}
 
-            		newState.IDEX.immed = ((newState.IDEX.instr)& 0x0000FFFF);
+/*************************************************************/
+/* The writeKernel function writes the assembly source of a  */
+/* benchmark kernel working on n array elements (or running  */
+/* n outer iterations). Array contents and the order of the  */
+/* linked list come from a fixed seed, so a kernel is the    */
+/* same on every run.                                        */
+/*************************************************************/
+void writeKernel(FILE *out, int kernel, int n){
+    unsigned int seed = 1;
+    int *order;
+    int i, j, t;
+
+#define NEXTRANDOM(seed) ((seed) = (seed) * 1103515245u + 12345u, (seed) >> 16)
+    fprintf(out, "# %s kernel of size %d\n", kernelNames[kernel], n);
+    switch (kernel) {
+        case KERNEL_SUM:
+            fprintf(out, "\tlw $1,parr($0)\n\tlw $3,pend($0)\n\tlw $2,four($0)\n");
+            fprintf(out, "loop:\tlw $4,0($1)\n\tadd $5,$5,$4\n\tadd $1,$1,$2\n\tbne $1,$3,loop\n");
+            fprintf(out, "\tsw $5,result($0)\n\thalt\n");
+            fprintf(out, "four:\t.word 4\nparr:\t.word arr\npend:\t.word arrend\nresult:\t.word 0\n");
+            for (i = 0; i < n; i++)
+                fprintf(out, "%s\t.word %u\n", i == 0 ? "arr:" : "", NEXTRANDOM(seed) % 100);
+            fprintf(out, "arrend:\t.word 0\n");
+            break;
+        case KERNEL_COPY:
+            fprintf(out, "\tlw $1,psrc($0)\n\tlw $6,pdst($0)\n\tlw $3,pend($0)\n\tlw $2,four($0)\n");
+            fprintf(out, "loop:\tlw $4,0($1)\n\tsw $4,0($6)\n\tadd $1,$1,$2\n\tadd $6,$6,$2\n\tbne $1,$3,loop\n");
+            fprintf(out, "\thalt\n");
+            fprintf(out, "four:\t.word 4\npsrc:\t.word src\npdst:\t.word dst\npend:\t.word dst\n");
+            for (i = 0; i < n; i++)
+                fprintf(out, "%s\t.word %u\n", i == 0 ? "src:" : "", NEXTRANDOM(seed) % 100);
+            fprintf(out, "dst:\t.space %d\n", 4 * n);
+            break;
+        case KERNEL_CHASE:
+            /* Sattolo's shuffle makes the list one cycle through all n */
+            /* nodes, which start after the 4 words of constants        */
+            order = malloc(sizeof(int) * n);
+            for (i = 0; i < n; i++)
+                order[i] = i;
+            for (i = n - 1; i > 0; i--) {
+                j = NEXTRANDOM(seed) % i;
+                t = order[i];
+                order[i] = order[j];
+                order[j] = t;
+            }
+            fprintf(out, "\tlw $1,phead($0)\n\tlw $7,count($0)\n\tlw $2,one($0)\n");
+            fprintf(out, "loop:\tlw $1,0($1)\n\tsub $7,$7,$2\n\tbne $7,$0,loop\n");
+            fprintf(out, "\tsw $1,result($0)\n\thalt\n");
+            fprintf(out, "one:\t.word 1\ncount:\t.word %d\nphead:\t.word list\nresult:\t.word 0\n", n);
+            for (i = 0; i < n; i++)
+                fprintf(out, "%s\t.word %d\n", i == 0 ? "list:" : "", 4 * (4 + order[i]));
+            free(order);
+            break;
+        case KERNEL_LOOP:
+            fprintf(out, "\tlw $2,one($0)\n\tlw $3,three($0)\n\tlw $7,count($0)\n");
+            fprintf(out, "outer:\tadd $6,$3,$0\ninner:\tsub $6,$6,$2\n\tbne $6,$0,inner\n");
+            fprintf(out, "\tsub $7,$7,$2\n\tbne $7,$0,outer\n\thalt\n");
+            fprintf(out, "one:\t.word 1\nthree:\t.word 3\ncount:\t.word %d\n", n);
+            break;
+        case KERNEL_CHAIN:
+            fprintf(out, "\tlw $2,one($0)\n\tlw $7,count($0)\n");
+            fprintf(out, "loop:\tadd $4,$4,$2\n\tadd $5,$4,$2\n\tsub $6,$5,$4\n\tadd $4,$4,$6\n");
+            fprintf(out, "\tadd $5,$4,$2\n\tsub $6,$5,$4\n\tadd $4,$4,$6\n\tadd $4,$4,$2\n");
+            fprintf(out, "\tsub $7,$7,$2\n\tbne $7,$0,loop\n");
+            fprintf(out, "\tsw $4,result($0)\n\thalt\n");
+            fprintf(out, "one:\t.word 1\ncount:\t.word %d\nresult:\t.word 0\n", n);
+            break;
+    }
+#undef NEXTRANDOM
+}
 
-               		newState.IDEX.rdReg = get_rd(newState.IDEX.instr);
-                       
-                	newState.IDEX.branchTarget = ((newState.IDEX.instr)& 0x0000FFFF);
+/*************************************************************/
+/* The runBatch function runs every job in the manifest on a */
+/* pool of worker threads. Jobs are dealt out round-robin to */
+/* per-worker deques; a worker runs its own jobs from the    */
+/* tail and, when it runs out, steals from the head of the   */
+/* other workers' deques, so long jobs do not leave cores    */
+/* idle. Blank lines and lines starting with # are skipped.  */
+/* With -lockstep only the first job of each lockstep group  */
+/* is dealt out (see groupJobs). Returns nonzero if the      */
+/* manifest cannot be read or any job failed.                */
+/*************************************************************/
+int runBatch(configType *config){
+    FILE *manifest;
+    poolType pool;
+    workerType *workers;
+    pthread_t *threads;
+    char line[4096];
+    char *start;
+    int *follower;
+    int cap = 0, lineNum = 0, failed = 0;
+    int i, k;
+
+    if ((manifest = fopen(config->manifest, "r")) == NULL) {
+        fprintf(stderr, "error: cannot open manifest %s\n", config->manifest);
+        return(1);
+    }
+    memset(&pool, 0, sizeof(pool));
+    while (fgets(line, sizeof(line), manifest)) {
+        lineNum++;
+        line[strcspn(line, "\r\n")] = '\0';
+        for (start = line; *start == ' ' || *start == '\t'; start++)
+            ;
+        if (*start == '\0' || *start == '#')
+            continue;
+        if (pool.numJobs == cap) {
+            cap = cap ? 2 * cap : 64;
+            pool.jobs = realloc(pool.jobs, sizeof(char*) * cap);
+            pool.lineNums = realloc(pool.lineNums, sizeof(int) * cap);
+        }
+        pool.jobs[pool.numJobs] = strdup(start);
+        pool.lineNums[pool.numJobs] = lineNum;
+        pool.numJobs++;
+    }
+    fclose(manifest);
+
+    pool.config = config;
+    follower = calloc(pool.numJobs + 1, sizeof(int));
+    if (config->lockstep)
+        groupJobs(&pool, follower);
+    pool.numThreads = config->threads ? config->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (pool.numThreads > pool.numJobs)
+        pool.numThreads = pool.numJobs;
+    if (pool.numThreads < 1)
+        pool.numThreads = 1;
+    pthread_mutex_init(&pool.outLock, NULL);
+    pool.deques = calloc(pool.numThreads, sizeof(dequeType));
+    for (i = 0; i < pool.numThreads; i++) {
+        pthread_mutex_init(&pool.deques[i].lock, NULL);
+        pool.deques[i].jobs = malloc(sizeof(int) * (pool.numJobs / pool.numThreads + 1));
+    }
+    for (i = 0, k = 0; i < pool.numJobs; i++) {
+        dequeType *deque = &pool.deques[k % pool.numThreads];
+        if (follower[i])
+            continue;
+        deque->jobs[deque->tail++] = i;
+        k++;
+    }
 
-				} else {
+    workers = malloc(sizeof(workerType) * pool.numThreads);
+    threads = malloc(sizeof(pthread_t) * pool.numThreads);
+    for (i = 0; i < pool.numThreads; i++) {
+        workers[i].pool = &pool;
+        workers[i].id = i;
+        pthread_create(&threads[i], NULL, batchWorker, &workers[i]);
+    }
+    for (i = 0; i < pool.numThreads; i++) {
+        void *status;
+        pthread_join(threads[i], &status);
+        failed |= (status != NULL);
+    }
 
-					newState.IDEX.immed = get_immed(newState.IDEX.instr);
-                       
-                	newState.IDEX.rdReg = 0;
-                       
-                	newState.IDEX.branchTarget = get_immed(newState.IDEX.instr);
+    for (i = 0; i < pool.numThreads; i++) {
+        pthread_mutex_destroy(&pool.deques[i].lock);
+        free(pool.deques[i].jobs);
+    }
+    for (i = 0; i < pool.numJobs; i++)
+        free(pool.jobs[i]);
+    pthread_mutex_destroy(&pool.outLock);
+    free(pool.deques);
+    free(pool.jobs);
+    free(pool.lineNums);
+    free(pool.groupNext);
+    free(follower);
+    free(workers);
+    free(threads);
+    return(failed);
+}
 
-				}
+/*************************************************************/
+/* The batchWorker function is the body of a batch worker    */
+/* thread. No jobs are added once the workers start, so a    */
+/* worker is done when its own deque and every other deque   */
+/* are empty. Returns non-NULL if any of its jobs failed.    */
+/*************************************************************/
+void *batchWorker(void *arg){
+    workerType *worker = arg;
+    poolType *pool = worker->pool;
+    dequeType *deque;
+    int job, i;
+    long failed = 0;
 
+    while (1) {
+        job = -1;
+        deque = &pool->deques[worker->id];
+        pthread_mutex_lock(&deque->lock);
+        if (deque->tail > deque->head)
+            job = deque->jobs[--deque->tail];
+        pthread_mutex_unlock(&deque->lock);
+
+        for (i = 1; job < 0 && i < pool->numThreads; i++) {
+            deque = &pool->deques[(worker->id + i) % pool->numThreads];
+            pthread_mutex_lock(&deque->lock);
+            if (deque->tail > deque->head)
+                job = deque->jobs[deque->head++];
+            pthread_mutex_unlock(&deque->lock);
         }
+        if (job < 0)
+            break;
+        failed |= runJob(pool, job);
+    }
+    return((void*)failed);
+}
 
-        /* --------------------- EX stage --------------------- */
+/*************************************************************/
+/* The runJob function runs one manifest line: a program     */
+/* file followed by options that override the command line.  */
+/* Tracing and -debug are off in batch mode. It prints a     */
+/* result line of the form                                   */
+/*   <line number> TAB <manifest line> TAB key=value ...     */
+/* and returns nonzero if the job failed. The first job of a */
+/* lockstep group runs the whole group instead.              */
+/*************************************************************/
+int runJob(poolType *pool, int job){
+    configType config = *pool->config;
+    programType program;
+    resultType result;
+    char *line;
+    char *file;
+    char out[512];
+    int status = 1;
+    FILE *in;
+
+    if (pool->groupNext != NULL && pool->groupNext[job] >= 0)
+        return(runLockstep(pool, job));
+
+    line = strdup(pool->jobs[job]);
+    memset(&result, 0, sizeof(result));
+    if (parseJob(line, &config, &file) != 0) {
+        snprintf(out, sizeof(out), "error=options");
+    } else if (config.restoreFile == NULL && (in = fopen(file, "r")) == NULL) {
+        snprintf(out, sizeof(out), "error=open");
+    } else {
+        config.traceAll = config.traceEvery = config.traceFirst = 0;
+        config.debugFile = NULL;
+        if (config.restoreFile != NULL) {
+            memset(&program, 0, sizeof(program));
+            status = 0;
+        } else {
+            status = loadProgram(in, file, &program);
+            fclose(in);
+        }
+        if (status == 0) {
+            status = simulate(&config, &program, &result);
+            freeProgram(&program);
+        }
+        batchResult(&config, &result, status, out, sizeof(out));
+    }
 
-        int regWrite = 0;
+    pthread_mutex_lock(&pool->outLock);
+    printf("%d\t%s\t%s\n", pool->lineNums[job], pool->jobs[job], out);
+    fflush(stdout);
+    pthread_mutex_unlock(&pool->outLock);
+    free(line);
+    return(status != 0);
+}
 
-        if(get_opcode(state.MEMWB.instr) == LW || R) {
+/* Split a manifest line into words in place and apply its options to config, */
+/* setting file to its program file. Returns nonzero if the options are wrong. */
+int parseJob(char *line, configType *config, char **file){
+    char *argv[128];
+    char *save;
+    int argc = 0;
+
+    for (argv[argc] = strtok_r(line, " \t", &save); argv[argc] != NULL && argc < 127;
+         argv[++argc] = strtok_r(NULL, " \t", &save))
+        ;
+    *file = argv[0];
+    config->manifest = NULL;
+    return(parseArgs(argc, argv, config));
+}
 
-        	regWrite = 1;
+/*************************************************************/
+/* The batchResult function formats the key=value part of a  */
+/* job's result line from the status simulate returned.      */
+/*************************************************************/
+void batchResult(configType *config, resultType *result, int status, char *out, size_t size){
+    char memory[256] = "";
+
+    if (status != 0 && !result->fault)
+        snprintf(out, size, "error=load");
+    else if (config->sampleUnit > 0)
+        snprintf(out, size, "instructions=%lld samples=%d cpi=%.4f+-%.4f stalls=%.4f+-%.4f mispredicted=%.4f+-%.4f%s",
+            result->instructions, result->samples, result->estimate[0], result->confidence[0],
+            result->estimate[1], result->confidence[1], result->estimate[2], result->confidence[2],
+            result->fault ? " error=fault" : "");
+    else {
+        if (config->ooo)
+            snprintf(memory, sizeof(memory), " robfull=%lld iqfull=%lld lsqfull=%lld regsfull=%lld",
+                result->stats.numRobFull, result->stats.numIqFull, result->stats.numLsqFull, result->stats.numRegsFull);
+        else if (config->width > 1)
+            snprintf(memory, sizeof(memory), " depsplits=%lld portsplits=%lld",
+                result->stats.numDepSplits, result->stats.numPortSplits);
+        if (config->cache[CACHE_L1I].size > 0)
+            snprintf(memory + strlen(memory), sizeof(memory) - strlen(memory), " fetchstalls=%lld l1i_misses=%lld",
+                result->stats.numFetchStalls, result->cache[CACHE_L1I].misses);
+        if (config->cache[CACHE_L1D].size > 0)
+            snprintf(memory + strlen(memory), sizeof(memory) - strlen(memory), " memstalls=%lld l1d_misses=%lld",
+                result->stats.numMemStalls, result->cache[CACHE_L1D].misses);
+        if (config->cache[CACHE_L2].size > 0 && memory[0] != '\0')
+            snprintf(memory + strlen(memory), sizeof(memory) - strlen(memory), " l2_misses=%lld",
+                result->cache[CACHE_L2].misses);
+        snprintf(out, size, "cycles=%lld instructions=%lld stalls=%lld branches=%lld mispredicted=%lld%s%s",
+            result->cycles, result->instructions, result->stats.numStalls,
+            result->stats.numBranches, result->stats.numMisPred, memory, result->fault ? " error=fault" : "");
+    }
+}
 
+/*************************************************************/
+/* The groupJobs function links the jobs that can be lanes   */
+/* of one lockstep simulation (see runLockstep): jobs that   */
+/* canLockstep accepts, that run the same program file with  */
+/* the same memory sizes and the same L1 caches present, and */
+/* either all or none of which have a dynamic branch         */
+/* predictor. pool->groupNext chains each group in manifest  */
+/* order, and follower[job] is set for every job but the     */
+/* first of its group.                                       */
+/*************************************************************/
+void groupJobs(poolType *pool, int *follower){
+    configType *configs = malloc(sizeof(configType) * pool->numJobs);
+    char **lines = malloc(sizeof(char*) * pool->numJobs);
+    char **files = malloc(sizeof(char*) * pool->numJobs);
+    int *ok = malloc(sizeof(int) * pool->numJobs);
+    int *last = malloc(sizeof(int) * pool->numJobs);
+    configType *a, *b;
+    int i, j;
+
+    pool->groupNext = malloc(sizeof(int) * pool->numJobs);
+    for (i = 0; i < pool->numJobs; i++) {
+        pool->groupNext[i] = -1;
+        follower[i] = 0;
+        last[i] = i;
+        configs[i] = *pool->config;
+        lines[i] = strdup(pool->jobs[i]);
+        ok[i] = parseJob(lines[i], &configs[i], &files[i]) == 0 && canLockstep(&configs[i]);
+        for (j = 0; ok[i] && j < i; j++) {
+            a = &configs[i];
+            b = &configs[j];
+            if (ok[j] && !follower[j] && strcmp(files[i], files[j]) == 0
+                && a->instrWords == b->instrWords && a->dataWords == b->dataWords
+                && (a->bpType == BP_NOTTAKEN) == (b->bpType == BP_NOTTAKEN)
+                && (a->cache[CACHE_L1I].size > 0) == (b->cache[CACHE_L1I].size > 0)
+                && (a->cache[CACHE_L1D].size > 0) == (b->cache[CACHE_L1D].size > 0)) {
+                pool->groupNext[last[j]] = i;
+                last[j] = i;
+                follower[i] = 1;
+                break;
+            }
         }
-//&& (state.EXMEM.writeReg != 0)
-        if((regWrite != 0)  && (state.EXMEM.writeReg == state.IDEX.rsReg)) {
-        	
-        	printf("\n(1a) ForwardA = 10\n");
-        	
-        	if(get_opcode(state.MEMWB.instr) == R) {
-        	
-        		state.IDEX.readData1 = state.EXMEM.aluResult;
-        		
-        	} else {
-       
-        		if(state.EXMEM.writeReg == state.IDEX.rtReg) {
-       
-        			state.IDEX.readData2 = state.MEMWB.writeDataMem;
-       
-        			state.IDEX.readData1 = state.MEMWB.writeDataMem;
-       
-        		} else {
-       
-        			state.IDEX.readData1 = state.MEMWB.writeDataMem;
-       
-        	}
-       
-        }
-        //&& (state.EXMEM.writeReg != 0)
-        } else if((regWrite != 0)  && (state.EXMEM.writeReg == state.IDEX.rtReg)) {
-        
-        	printf("\n(1b) ForwardB = 10\n");
+    }
+    for (i = 0; i < pool->numJobs; i++)
+        free(lines[i]);
+    free(configs);
+    free(lines);
+    free(files);
+    free(ok);
+    free(last);
+}
 
-        	if(get_opcode(state.MEMWB.instr == R)) {
-        
-        		state.IDEX.readData2 = state.EXMEM.aluResult;
-        	
-        	} else {
+/* Nonzero if a job with these options can be a lockstep lane: the in-order */
+/* pipeline run from the start of a program, for the final counters only */
+int canLockstep(configType *config){
+    return(config->width == 1 && !config->ooo && config->cores <= 1 && !config->functional
+        && config->fastForward == 0 && config->sampleUnit == 0 && !config->check
+        && config->restoreFile == NULL && config->saveFile == NULL && config->imageFile == NULL
+        && config->timelineFile == NULL && config->statsFile == NULL && config->konataFile == NULL
+        && config->benchSize == 0 && config->kernel < 0);
+}
 
-        		if(state.EXMEM.writeReg == state.IDEX.rsReg) {
+/*************************************************************/
+/* The runLockstep function runs the group of jobs starting  */
+/* with first (see groupJobs) as the lanes of one lockstep   */
+/* simulation. The program is loaded once and only one       */
+/* lane's pipeline is simulated at first; the other lanes    */
+/* follow it, repeating its branch predictor and cache       */
+/* accesses on their own predictors and caches. As long as   */
+/* those give the same answers, every lane's pipeline goes   */
+/* through the same states, so the stage logic runs once for */
+/* the whole group. A lane whose predictor or cache answers  */
+/* differently splits off with a copy of the pipeline state  */
+/* (see laneSplit) and leads a group of its own. The groups  */
+/* take turns retiring LOCKSTEPSLICE instructions, and after */
+/* each round the groups that have come back to the same     */
+/* state are merged (see mergeLanes), as happens once the    */
+/* predictors and caches have warmed up. Prints a result     */
+/* line for every job and returns nonzero if any failed.     */
+/*************************************************************/
+int runLockstep(poolType *pool, int first){
+    lockstepType ls;
+    programType program;
+    stateType shared;
+    resultType *results;
+    simType *sim;
+    char **lines;
+    char *file = NULL;
+    char out[512];
+    int *jobs;
+    int i, k, job, status, loaded = 0, failed = 0;
+    long long target;
+    FILE *in;
+
+    for (ls.numLanes = 0, job = first; job >= 0; job = pool->groupNext[job])
+        ls.numLanes++;
+    ls.lanes = calloc(ls.numLanes, sizeof(simType));
+    ls.configs = malloc(sizeof(configType) * ls.numLanes);
+    ls.ready = malloc(sizeof(simType*) * ls.numLanes);
+    ls.numReady = 0;
+    ls.offsets = calloc(ls.numLanes, sizeof(statsType));
+    ls.cycleOffsets = calloc(ls.numLanes, sizeof(long long));
+    ls.failed = calloc(ls.numLanes, sizeof(int));
+    results = calloc(ls.numLanes, sizeof(resultType));
+    lines = malloc(sizeof(char*) * ls.numLanes);
+    jobs = malloc(sizeof(int) * ls.numLanes);
+    for (i = 0, job = first; job >= 0; i++, job = pool->groupNext[job]) {
+        jobs[i] = job;
+        lines[i] = strdup(pool->jobs[job]);
+        ls.configs[i] = *pool->config;
+        parseJob(lines[i], &ls.configs[i], &file); /* Already checked by groupJobs */
+        ls.configs[i].traceAll = ls.configs[i].traceEvery = ls.configs[i].traceFirst = 0;
+    }
 
-        			state.IDEX.readData1 = state.MEMWB.writeDataMem;
+    if ((in = fopen(file, "r")) == NULL) {
+        status = -1;
+    } else {
+        status = loadProgram(in, file, &program);
+        fclose(in);
+        loaded = (status == 0);
+    }
+    if (status == 0)
+        status = initState(&shared, &ls.configs[0], &program);
+    if (status == 0) {
+        /* The lane with the longest branch history leads, see lanePredict */
+        ls.dataMem = shared.dataMem;
+        for (i = k = 0; i < ls.numLanes; i++) {
+            sim = &ls.lanes[i];
+            sim->config = &ls.configs[i];
+            initPredictor(&sim->pred, sim->config);
+            initCaches(sim->cache, sim->config);
+            sim->lockstep = &ls;
+            if (sim->pred.mask > ls.lanes[k].pred.mask)
+                k = i;
+        }
+        for (i = 0, sim = &ls.lanes[k]; i < ls.numLanes; i++)
+            if (i != k) {
+                sim->nextLane = &ls.lanes[i];
+                sim = sim->nextLane;
+            }
+        ls.lanes[k].state = shared;
+        ls.ready[ls.numReady++] = &ls.lanes[k];
+        for (target = LOCKSTEPSLICE; ls.numReady > 0; target += LOCKSTEPSLICE) {
+            /* Groups split off during the round get their turn in it too */
+            for (i = 0; i < ls.numReady; i++) {
+                sim = ls.ready[i];
+                while (sim->stats.instructions + ls.offsets[sim - ls.lanes].instructions < target)
+                    if (cycle(sim, 1)) {
+                        laneResults(&ls, sim, results);
+                        ls.ready[i] = NULL;
+                        break;
+                    }
+            }
+            for (i = k = 0; i < ls.numReady; i++)
+                if (ls.ready[i] != NULL)
+                    ls.ready[k++] = ls.ready[i];
+            ls.numReady = k;
+            mergeLanes(&ls);
+        }
+    }
 
-        			state.IDEX.readData2 = state.MEMWB.writeDataMem;
+    pthread_mutex_lock(&pool->outLock);
+    for (i = 0; i < ls.numLanes; i++) {
+        if (status < 0)
+            snprintf(out, sizeof(out), "error=open");
+        else if (ls.failed[i])
+            snprintf(out, sizeof(out), "error=memory");
+        else
+            batchResult(&ls.configs[i], &results[i], status ? status : results[i].fault, out, sizeof(out));
+        failed |= (status != 0 || results[i].fault || ls.failed[i]);
+        printf("%d\t%s\t%s\n", pool->lineNums[jobs[i]], pool->jobs[jobs[i]], out);
+    }
+    fflush(stdout);
+    pthread_mutex_unlock(&pool->outLock);
+
+    for (i = 0; i < ls.numLanes; i++) {
+        if (status == 0) {
+            freePredictor(&ls.lanes[i].pred);
+            freeCaches(ls.lanes[i].cache);
+            if (ls.lanes[i].state.dataMem != NULL && ls.lanes[i].state.dataMem != ls.dataMem)
+                freeMemory(ls.lanes[i].state.dataMem, 4 * (size_t)ls.lanes[i].state.numDataMem);
+        }
+        free(lines[i]);
+    }
+    if (status == 0)
+        freeState(&shared);
+    if (loaded)
+        freeProgram(&program);
+    free(ls.lanes);
+    free(ls.configs);
+    free(ls.ready);
+    free(ls.offsets);
+    free(ls.cycleOffsets);
+    free(ls.failed);
+    free(results);
+    free(lines);
+    free(jobs);
+    return(failed);
+}
 
-        		} else {
+/* Record the results of the lanes in the group sim leads, which has run to the end */
+void laneResults(lockstepType *ls, simType *sim, resultType *results){
+    simType *lane;
+    int i, c;
+
+    for (lane = sim; lane != NULL; lane = lane->nextLane) {
+        i = lane - ls->lanes;
+        results[i].stats = sim->stats;
+        for (c = 0; c < (int)NUMCOUNTERS; c++)
+            COUNTER(&results[i].stats, c) += COUNTER(&ls->offsets[i], c);
+        results[i].cycles = sim->state.cycles + ls->cycleOffsets[i];
+        results[i].instructions = results[i].stats.instructions;
+        results[i].fault = sim->state.fault;
+        for (c = 0; c < NUMCACHES; c++)
+            results[i].cache[c] = lane->cache[c].stats;
+    }
+}
 
-        			state.IDEX.readData2 = state.MEMWB.writeDataMem;
+/*************************************************************/
+/* The mergeLanes function merges lockstep groups whose      */
+/* leaders are in the same state (see sameLane) into one.    */
+/* From then on they go through the same states for as long  */
+/* as their predictors and caches agree, only their counters */
+/* and cycles differ by what they were when they merged; the */
+/* difference is kept in offsets and cycleOffsets. The       */
+/* leader with the longer branch history leads the merged    */
+/* group, so that the history the pipeline carries has the   */
+/* bits every lane needs (see lanePredict).                  */
+/*************************************************************/
+void mergeLanes(lockstepType *ls){
+    simType *a, *b, *lane;
+    unsigned int mask;
+    int i, j, k, c;
+
+    for (i = 0; i < ls->numReady; i++) {
+        for (j = i + 1; j < ls->numReady && ls->ready[i] != NULL; j++) {
+            if ((b = ls->ready[j]) == NULL)
+                continue;
+            a = ls->ready[i];
+            if (b->pred.mask > a->pred.mask) {
+                a = b;
+                b = ls->ready[i];
+            }
+            for (mask = 0, lane = b; lane != NULL; lane = lane->nextLane)
+                mask |= lane->pred.mask;
+            if (!sameLane(&a->state, &b->state, mask))
+                continue;
+            for (lane = b; lane != NULL; lane = lane->nextLane) {
+                k = lane - ls->lanes;
+                for (c = 0; c < (int)NUMCOUNTERS; c++)
+                    COUNTER(&ls->offsets[k], c) += COUNTER(&b->stats, c) - COUNTER(&a->stats, c);
+                ls->cycleOffsets[k] += b->state.cycles - a->state.cycles;
+            }
+            for (lane = a; lane->nextLane != NULL; lane = lane->nextLane)
+                ;
+            lane->nextLane = b;
+            if (b->state.dataMem != ls->dataMem)
+                freeMemory(b->state.dataMem, 4 * (size_t)b->state.numDataMem);
+            b->state.dataMem = NULL;
+            ls->ready[i] = a;
+            ls->ready[j] = NULL;
+        }
+    }
+    for (i = k = 0; i < ls->numReady; i++)
+        if (ls->ready[i] != NULL)
+            ls->ready[k++] = ls->ready[i];
+    ls->numReady = k;
+}
 
-        		}
+/*************************************************************/
+/* The sameLane function returns nonzero if the in-order     */
+/* pipeline goes on the same way from state a as from state  */
+/* b, for lanes that use the low mask bits of the branch     */
+/* history. The dynamic instruction numbers may differ, as   */
+/* they are only used in timelines.                          */
+/*************************************************************/
+int sameLane(stateType *a, stateType *b, unsigned int mask){
+    IFIDType ifid[2];
+    IDEXType idex[2];
+    EXMEMType exmem[2];
+    MEMWBType memwb[2];
+    stateType *s[2];
+    pipeType *pipe;
+    int i;
 
-        	}
+    if (a->PC != b->PC || a->fault || b->fault
+        || a->memStall != b->memStall || a->memDone != b->memDone
+        || a->fetchStall != b->fetchStall || a->fetchDone != b->fetchDone
+        || memcmp(a->regFile, b->regFile, sizeof(a->regFile)) != 0)
+        return(0);
+    s[0] = a;
+    s[1] = b;
+    for (i = 0; i < 2; i++) {
+        pipe = &s[i]->pipe[s[i]->cur];
+        ifid[i] = pipe->IFID[0];
+        idex[i] = pipe->IDEX[0];
+        exmem[i] = pipe->EXMEM[0];
+        memwb[i] = pipe->MEMWB[0];
+        ifid[i].predHist &= mask;
+        idex[i].predHist &= mask;
+        ifid[i].id = (ifid[i].id != 0);
+        idex[i].id = (idex[i].id != 0);
+        exmem[i].id = (exmem[i].id != 0);
+        memwb[i].id = (memwb[i].id != 0);
+    }
+    return(memcmp(&ifid[0], &ifid[1], sizeof(IFIDType)) == 0
+        && memcmp(&idex[0], &idex[1], sizeof(IDEXType)) == 0
+        && memcmp(&exmem[0], &exmem[1], sizeof(EXMEMType)) == 0
+        && memcmp(&memwb[0], &memwb[1], sizeof(MEMWBType)) == 0
+        && memcmp(a->dataMem, b->dataMem, 4 * (size_t)a->numDataMem) == 0);
+}
 
-        } else if((regWrite != 0)  && (state.MEMWB.writeReg == state.IDEX.rsReg)
-        	&& !((regWrite != 0)  && (state.EXMEM.writeReg == state.IDEX.rsReg))) {
-        
-            printf("\n(2a) ForwardA = 01\n");
+/*************************************************************/
+/* The laneAccess function repeats a cache access made by    */
+/* the pipeline of sim, which took latency extra cycles, on  */
+/* the lanes following it. A lane whose cache takes a        */
+/* different number of cycles splits off, with its access    */
+/* made; lanes that split off with the same latency in the   */
+/* same access stay together.                                */
+/*************************************************************/
+void laneAccess(simType *sim, int level, unsigned int addr, int write, int latency){
+    lockstepType *ls = sim->lockstep;
+    simType **link = &sim->nextLane;
+    simType *lane, *leader;
+    int mark = ls->numReady;
+    int i, extra;
+
+    while ((lane = *link) != NULL) {
+        extra = cacheAccess(&lane->cache[level], addr, write);
+        if (extra == latency) {
+            link = &lane->nextLane;
+            continue;
+        }
+        *link = lane->nextLane;
+        for (i = mark; i < ls->numReady; i++) {
+            leader = ls->ready[i];
+            if ((level == CACHE_L1D ? leader->state.memStall : leader->state.fetchStall) == extra)
+                break;
+        }
+        if (i < ls->numReady) {
+            lane->nextLane = leader->nextLane;
+            leader->nextLane = lane;
+        } else if (laneSplit(sim, lane) == NULL) {
+            ls->failed[lane - ls->lanes] = 1;
+        } else if (level == CACHE_L1D) {
+            lane->state.memStall = extra;
+            lane->state.memDone = 1;
+        } else {
+            lane->state.fetchStall = extra;
+            lane->state.fetchDone = 1;
+        }
+    }
+}
 
-            state.IDEX.readData1 = state.MEMWB.writeDataMem;
-        //&& (state.MEMWB.writeReg != 0)
-         //   && (state.EXMEM.writeReg != 0)
-        } else if((regWrite != 0)  && (state.MEMWB.writeReg == state.IDEX.rtReg)
-        	&& !((regWrite != 0)  && (state.EXMEM.writeReg == state.IDEX.rtReg))) {
-        
-            printf("\n(2b) ForwardB = 01\n");
+/*************************************************************/
+/* The lanePredict function checks that the predictors of    */
+/* the lanes following sim predict the fetch at pc the same  */
+/* way. A predictor keeps as many bits of global history as  */
+/* its tables have index bits, so a lane's history must be   */
+/* the low bits of hist; the pipeline carries hist and each  */
+/* lane trains on its own bits of it (see laneUpdate). Lanes */
+/* that do not agree split off as in laneAccess and fetch    */
+/* again on their own, without repeating the instruction     */
+/* cache access.                                             */
+/*************************************************************/
+void lanePredict(simType *sim, int pc, int taken, unsigned int hist, int target){
+    lockstepType *ls = sim->lockstep;
+    simType **link = &sim->nextLane;
+    simType *lane, *leader;
+    unsigned int laneHist, leaderHist;
+    int laneTaken, laneTarget = 0, leaderTarget = 0;
+    int mark = ls->numReady;
+    int i;
 
-            state.IDEX.readData2 = state.MEMWB.writeDataMem;
-        
+    while ((lane = *link) != NULL) {
+        laneTaken = predictBranch(&lane->pred, pc, &laneHist, &laneTarget);
+        if (laneTaken == taken && laneHist == (hist & lane->pred.mask) && (!taken || laneTarget == target)) {
+            link = &lane->nextLane;
+            continue;
+        }
+        *link = lane->nextLane;
+        for (i = mark; i < ls->numReady; i++) {
+            leader = ls->ready[i];
+            if (predictBranch(&leader->pred, pc, &leaderHist, &leaderTarget) == laneTaken
+                && (leaderHist & lane->pred.mask) == laneHist && (!laneTaken || leaderTarget == laneTarget))
+                break;
+        }
+        if (i < ls->numReady) {
+            lane->nextLane = leader->nextLane;
+            leader->nextLane = lane;
+        } else if (laneSplit(sim, lane) == NULL) {
+            ls->failed[lane - ls->lanes] = 1;
+        } else if (lane->cache[CACHE_L1I].tags != NULL) {
+            lane->state.fetchDone = 1;
         }
+    }
+}
 
-        newState.EXMEM.instr = state.IDEX.instr;
+/* Train the predictors of the lanes following sim on a resolved branch, as updatePredictor */
+void laneUpdate(simType *sim, int pc, unsigned int hist, int taken, int target){
+    simType *lane;
 
-            switch(get_opcode(newState.EXMEM.instr)) {
+    for (lane = sim->nextLane; lane != NULL; lane = lane->nextLane)
+        updatePredictor(&lane->pred, pc, hist & lane->pred.mask, taken, target);
+}
 
-                case LW:
+/*************************************************************/
+/* The laneSplit function makes lane, which has just         */
+/* answered differently from sim, the lane it follows, the   */
+/* leader of a new group. It gets a copy of sim's pipeline   */
+/* state, which is still as it was at the beginning of the   */
+/* cycle apart from what the caller puts right, and of its   */
+/* counters, and is queued to run the cycle itself. Returns  */
+/* lane, or NULL, leaving lane out of every group, if its    */
+/* data memory cannot be allocated.                          */
+/*************************************************************/
+simType *laneSplit(simType *sim, simType *lane){
+    size_t bytes = 4 * (size_t)sim->state.numDataMem;
+    int *dataMem;
+
+    if ((dataMem = allocMemory(bytes)) == NULL)
+        return(NULL);
+    lane->state = sim->state;
+    lane->state.dataMem = dataMem;
+    memcpy(lane->state.dataMem, sim->state.dataMem, bytes);
+    lane->state.blocks = NULL;
+    lane->stats = sim->stats;
+    lane->pipeline = sim->pipeline;
+    lane->nextLane = NULL;
+    sim->lockstep->ready[sim->lockstep->numReady++] = lane;
+    return(lane);
+}
 
-                    newState.EXMEM.writeReg = get_rt(newState.EXMEM.instr);
+/*************************************************************/
+/* The runPipeline function runs the pipeline model until    */
+/* count more instructions have retired, leaving the         */
+/* pipeline full. Returns nonzero if the program halted.     */
+/*************************************************************/
+int runPipeline(simType *sim, long long count){
+    long long last = sim->stats.instructions + count;
 
-                    newState.EXMEM.writeDataReg = state.regFile[get_rt(newState.EXMEM.instr)];
+    while (sim->stats.instructions < last)
+        if (cycle(sim, 1))
+            return(1);
+    return(0);
+}
 
-                    newState.EXMEM.aluResult = ((state.IDEX.readData1) + (state.IDEX.immed));
+/*************************************************************/
+/* The drainPipeline function stops fetching and runs until  */
+/* every instruction in flight has retired or been squashed, */
+/* so that PC, regFile and dataMem describe a precise state  */
+/* the functional engine can continue from. Returns nonzero  */
+/* if the program halted.                                    */
+/*************************************************************/
+int drainPipeline(simType *sim){
+    pipeType *pipe;
+    int i;
 
-                    break;
+    while (sim->ooo != NULL && (sim->ooo->robCount > 0 || sim->ooo->fqCount > 0))
+        if (cycle(sim, 0))
+            return(1);
+    while (1) {
+        pipe = &sim->state.pipe[sim->state.cur];
+        for (i = 0; i < sim->state.width; i++)
+            if (pipe->IFID[i].instr != NOOPINDEX || pipe->IDEX[i].instr != NOOPINDEX
+                || pipe->EXMEM[i].instr != NOOPINDEX)
+                break;
+        if (i == sim->state.width)
+            break;
+        if (cycle(sim, 0))
+            return(1);
+    }
+    resetPipeline(&sim->state);
+    return(0);
+}
 
-                case SW:
-                    
-                    newState.EXMEM.writeReg = get_rt(newState.EXMEM.instr);
+/*************************************************************/
+/* The runSampled function estimates performance by sampling */
+/* (as in SMARTS). Every sampling period of sampleUnit +     */
+/* sampleWarm + sampleSkip instructions, it executes         */
+/* sampleSkip instructions functionally, sampleWarm in the   */
+/* pipeline to warm up the pipeline and branch predictor,    */
+/* and then measures sampleUnit instructions in detail. The  */
+/* estimates are the mean over the measured units, with 95%  */
+/* confidence intervals from their standard deviation.       */
+/* Runs until the program halts.                             */
+/*************************************************************/
+void runSampled(simType *sim, resultType *result){
+    configType *config = sim->config;
+    statsType start;           /* Counters at the start of a measured unit */
+    long long startCycles;
+    long long instrs;
+    double cpi, stalls, misPred;
+    double sum[3] = {0, 0, 0}, sumSq[3] = {0, 0, 0};
+    int n = 0, nBranch = 0;    /* Units measured, and units that had branches */
+    int halted = 0;
+    int i;
 
-                    newState.EXMEM.writeDataReg = get_rt(newState.EXMEM.instr);//state.regFile[get_rt(newState.EXMEM.instr)];
+    while (!halted) {
+        /* Fast-forward; stopping short means the next instruction is a HALT */
+        instrs = runFunctional(&sim->state, config->sampleSkip);
+        result->instructions += instrs;
+        if (sim->checker != NULL)
+            skipChecker(sim, instrs);
+        if (sim->state.fault)
+            break;
+
+        /* Warm up from an empty pipeline, then measure a unit */
+        instrs = sim->stats.instructions;
+        halted = runPipeline(sim, config->sampleWarm);
+        start = sim->stats;
+        startCycles = sim->state.cycles;
+        if (!halted)
+            halted = runPipeline(sim, config->sampleUnit);
+        if (sim->stats.instructions > start.instructions) {
+            cpi = (double)(sim->state.cycles - startCycles) / (sim->stats.instructions - start.instructions);
+            stalls = (double)(sim->stats.numStalls - start.numStalls) / (sim->stats.instructions - start.instructions);
+            sum[0] += cpi;
+            sumSq[0] += cpi * cpi;
+            sum[1] += stalls;
+            sumSq[1] += stalls * stalls;
+            n++;
+            if (sim->stats.numBranches > start.numBranches) {
+                misPred = (double)(sim->stats.numMisPred - start.numMisPred) / (sim->stats.numBranches - start.numBranches);
+                sum[2] += misPred;
+                sumSq[2] += misPred * misPred;
+                nBranch++;
+            }
+        }
+        if (!halted)
+            halted = drainPipeline(sim);
+        result->instructions += sim->stats.instructions - instrs;
+    }
+
+    result->samples = n;
+    for (i = 0; i < 3; i++) {
+        int count = (i == 2) ? nBranch : n;
+        double mean = count ? sum[i] / count : 0;
+        double var = count > 1 ? (sumSq[i] - count * mean * mean) / (count - 1) : 0;
+
+        result->estimate[i] = mean;
+        result->confidence[i] = count > 1 ? 1.96 * sqrt(var > 0 ? var : 0) / sqrt(count) : 0;
+    }
+}
+
+/*************************************************************/
+/* The saveCheckpoint function writes the simulator state to */
+/* a file: a checkpointType header holding PC, the register  */
+/* file, the current pipeline registers, the cycle count,    */
+/* the statistics and the predictor and cache geometry, then */
+/* the predictor tables, then the tags, stamps and dirty     */
+/* bits of each cache, then the instruction and data memory  */
+/* images at CKPTALIGN-aligned offsets so that they can be   */
+/* mapped straight into memory on restore. Trailing zero     */
+/* words of the memories are not stored. Returns nonzero on  */
+/* failure.                                                  */
+/*************************************************************/
+int saveCheckpoint(simType *sim, char *file){
+    stateType *statePtr = &sim->state;
+    predictorType *pred = &sim->pred;
+    checkpointType ckpt;
+    cacheSaveType *save;
+    FILE *out;
+    long long offset;
+    int ok, level;
+
+    if (sim->ooo != NULL)
+        return(1); /* the format has no room for the out-of-order state */
+    memset(&ckpt, 0, sizeof(ckpt));
+    memcpy(ckpt.magic, CKPTMAGIC, sizeof(ckpt.magic));
+    ckpt.version = CKPTVERSION;
+    ckpt.pipeSize = sizeof(pipeType);
+    ckpt.PC = statePtr->PC;
+    ckpt.numInstrMem = statePtr->numInstrMem;
+    ckpt.numDataMem = statePtr->numDataMem;
+    for (ckpt.savedInstrMem = statePtr->numInstrMem;
+         ckpt.savedInstrMem > 0 && statePtr->instrMem[ckpt.savedInstrMem - 1] == 0; ckpt.savedInstrMem--)
+        ;
+    for (ckpt.savedDataMem = statePtr->numDataMem;
+         ckpt.savedDataMem > 0 && statePtr->dataMem[ckpt.savedDataMem - 1] == 0; ckpt.savedDataMem--)
+        ;
+    memcpy(ckpt.regFile, statePtr->regFile, sizeof(ckpt.regFile));
+    ckpt.cycles = statePtr->cycles;
+    ckpt.pipe = statePtr->pipe[statePtr->cur];
+    ckpt.stats = sim->stats;
+    ckpt.bpType = pred->type;
+    ckpt.bpMask = pred->mask;
+    ckpt.btbMask = pred->btbMask;
+    ckpt.history = pred->history;
+    ckpt.memStall = statePtr->memStall;
+    ckpt.memDone = statePtr->memDone;
+    ckpt.fetchStall = statePtr->fetchStall;
+    ckpt.fetchDone = statePtr->fetchDone;
+    ckpt.width = statePtr->width;
+    ckpt.nextId = statePtr->nextId;
+
+    offset = sizeof(ckpt);
+    if (pred->type != BP_NOTTAKEN)
+        offset += 3 * ((long long)pred->mask + 1) + sizeof(btbEntryType) * ((long long)pred->btbMask + 1);
+    for (level = 0; level < NUMCACHES; level++) {
+        cacheType *cache = &sim->cache[level];
+        if (cache->tags == NULL)
+            continue;
+        save = &ckpt.cache[level];
+        save->lines = (int)(cache->setMask + 1) * cache->ways;
+        save->ways = cache->ways;
+        save->lineShift = cache->lineShift;
+        save->replacement = cache->replacement;
+        save->writeThrough = cache->writeThrough;
+        save->clock = cache->clock;
+        save->seed = cache->seed;
+        save->stats = cache->stats;
+        offset += 9LL * save->lines;
+    }
+    ckpt.instrOffset = (offset + CKPTALIGN - 1) / CKPTALIGN * CKPTALIGN;
+    ckpt.dataOffset = (ckpt.instrOffset + 4LL * ckpt.savedInstrMem + CKPTALIGN - 1) / CKPTALIGN * CKPTALIGN;
+
+    if ((out = fopen(file, "wb")) == NULL)
+        return(1);
+    ok = fwrite(&ckpt, sizeof(ckpt), 1, out) == 1;
+    if (ok && pred->type != BP_NOTTAKEN)
+        ok = fwrite(pred->bimodal, pred->mask + 1, 1, out) == 1
+            && fwrite(pred->gshare, pred->mask + 1, 1, out) == 1
+            && fwrite(pred->chooser, pred->mask + 1, 1, out) == 1
+            && fwrite(pred->btb, sizeof(btbEntryType) * (pred->btbMask + 1), 1, out) == 1;
+    for (level = 0; ok && level < NUMCACHES; level++)
+        if (ckpt.cache[level].lines > 0)
+            ok = fwrite(sim->cache[level].tags, 4 * (size_t)ckpt.cache[level].lines, 1, out) == 1
+                && fwrite(sim->cache[level].stamps, 4 * (size_t)ckpt.cache[level].lines, 1, out) == 1
+                && fwrite(sim->cache[level].dirty, ckpt.cache[level].lines, 1, out) == 1;
+    if (ok && ckpt.savedInstrMem > 0)
+        ok = fseeko(out, ckpt.instrOffset, SEEK_SET) == 0
+            && fwrite(statePtr->instrMem, 4 * (size_t)ckpt.savedInstrMem, 1, out) == 1;
+    if (ok && ckpt.savedDataMem > 0)
+        ok = fseeko(out, ckpt.dataOffset, SEEK_SET) == 0
+            && fwrite(statePtr->dataMem, 4 * (size_t)ckpt.savedDataMem, 1, out) == 1;
+    if (fclose(out) != 0)
+        ok = 0;
+    return(!ok);
+}
+
+/*************************************************************/
+/* The mapImage function returns total bytes of zeroed       */
+/* memory whose first bytes are a private, copy-on-write     */
+/* mapping of the file at offset, so that large images are   */
+/* paged in on demand rather than read. Returns NULL on      */
+/* failure.                                                  */
+/*************************************************************/
+void *mapImage(int fd, long long offset, size_t bytes, size_t total){
+    void *mem = allocMemory(total);
+
+    if (mem != NULL && bytes > 0
+        && mmap(mem, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, offset) == MAP_FAILED) {
+        freeMemory(mem, total);
+        return(NULL);
+    }
+    return(mem);
+}
+
+/*************************************************************/
+/* The restoreCheckpoint function replaces initState when    */
+/* starting from a checkpoint written by saveCheckpoint. The */
+/* memories are mapped from the file. The predictor tables   */
+/* are restored only if the configured predictor has the     */
+/* same type and sizes; otherwise it starts cold, which lets */
+/* one checkpoint be reused with different predictors. Each */
+/* cache is restored in the same way if it is configured     */
+/* with the same geometry, replacement and write policy.     */
+/* Returns nonzero on failure.                               */
+/*************************************************************/
+int restoreCheckpoint(simType *sim, char *file){
+    stateType *statePtr = &sim->state;
+    predictorType *pred = &sim->pred;
+    checkpointType ckpt;
+    cacheSaveType *save;
+    cacheType *cache;
+    long long offset = sizeof(ckpt);
+    int fd, i, ok = 1;
+
+    memset(statePtr, 0, sizeof(*statePtr));
+    if ((fd = open(file, O_RDONLY)) < 0) {
+        fprintf(stderr, "error: cannot open checkpoint %s\n", file);
+        return(1);
+    }
+    if (pread(fd, &ckpt, sizeof(ckpt), 0) != sizeof(ckpt)
+        || memcmp(ckpt.magic, CKPTMAGIC, sizeof(ckpt.magic)) != 0
+        || ckpt.version != CKPTVERSION || ckpt.pipeSize != sizeof(pipeType)) {
+        fprintf(stderr, "error: %s is not a version %d checkpoint from this simulator\n", file, CKPTVERSION);
+        close(fd);
+        return(1);
+    }
+    if (ckpt.width != sim->config->width) {
+        fprintf(stderr, "error: %s was saved with -width %d\n", file, ckpt.width);
+        close(fd);
+        return(1);
+    }
+
+    statePtr->PC = ckpt.PC;
+    statePtr->numInstrMem = ckpt.numInstrMem;
+    statePtr->numDataMem = ckpt.numDataMem;
+    memcpy(statePtr->regFile, ckpt.regFile, sizeof(ckpt.regFile));
+    statePtr->cycles = ckpt.cycles;
+    statePtr->pipe[0] = statePtr->pipe[1] = ckpt.pipe;
+    statePtr->memStall = ckpt.memStall;
+    statePtr->memDone = ckpt.memDone;
+    statePtr->fetchStall = ckpt.fetchStall;
+    statePtr->fetchDone = ckpt.fetchDone;
+    statePtr->width = ckpt.width;
+    statePtr->nextId = ckpt.nextId;
+    sim->stats = ckpt.stats;
+
+    statePtr->instrMem = mapImage(fd, ckpt.instrOffset, 4 * (size_t)ckpt.savedInstrMem, 4 * (size_t)ckpt.numInstrMem);
+    statePtr->dataMem = mapImage(fd, ckpt.dataOffset, 4 * (size_t)ckpt.savedDataMem, 4 * (size_t)ckpt.numDataMem);
+    statePtr->decodedMem = allocMemory(sizeof(decodedType) * ((size_t)ckpt.numInstrMem + 2));
+    statePtr->blocks = NULL;
+    if (statePtr->instrMem == NULL || statePtr->dataMem == NULL || statePtr->decodedMem == NULL)
+        ok = 0;
+    for (i = 0; ok && i < ckpt.savedInstrMem; i++)
+        decodeInstr(statePtr->instrMem[i], &statePtr->decodedMem[DECODEDINDEX(4 * i)]);
+    if (ok)
+        decodeInstr((unsigned int)HALT << 26, &statePtr->decodedMem[ENDINDEX(statePtr)]);
+
+    if (ok && ckpt.bpType == pred->type && ckpt.bpMask == pred->mask
+        && ckpt.btbMask == pred->btbMask && pred->type != BP_NOTTAKEN) {
+        ok = pread(fd, pred->bimodal, pred->mask + 1, offset) == pred->mask + 1
+            && pread(fd, pred->gshare, pred->mask + 1, offset + pred->mask + 1) == pred->mask + 1
+            && pread(fd, pred->chooser, pred->mask + 1, offset + 2 * (pred->mask + 1)) == pred->mask + 1
+            && pread(fd, pred->btb, sizeof(btbEntryType) * (pred->btbMask + 1), offset + 3 * (pred->mask + 1))
+                == (ssize_t)(sizeof(btbEntryType) * (pred->btbMask + 1));
+        pred->history = ckpt.history;
+    }
+
+    if (ckpt.bpType != BP_NOTTAKEN)
+        offset += 3 * ((long long)ckpt.bpMask + 1) + sizeof(btbEntryType) * ((long long)ckpt.btbMask + 1);
+    for (i = 0; ok && i < NUMCACHES; offset += 9LL * save->lines, i++) {
+        save = &ckpt.cache[i];
+        cache = &sim->cache[i];
+        if (save->lines == 0 || cache->tags == NULL || save->lines != (int)(cache->setMask + 1) * cache->ways
+            || save->ways != cache->ways || save->lineShift != cache->lineShift
+            || save->replacement != cache->replacement || save->writeThrough != cache->writeThrough)
+            continue;
+        ok = pread(fd, cache->tags, 4 * (size_t)save->lines, offset) == 4 * (ssize_t)save->lines
+            && pread(fd, cache->stamps, 4 * (size_t)save->lines, offset + 4LL * save->lines) == 4 * (ssize_t)save->lines
+            && pread(fd, cache->dirty, save->lines, offset + 8LL * save->lines) == save->lines;
+        cache->clock = save->clock;
+        cache->seed = save->seed;
+        cache->stats = save->stats;
+    }
+    close(fd);
+    if (!ok) {
+        fprintf(stderr, "error: cannot read checkpoint %s\n", file);
+        freeState(statePtr);
+        return(1);
+    }
+    return(0);
+}
+
+/*************************************************************/
+/* The cycle function advances the pipeline model by one     */
+/* clock cycle. If fetch is zero, IF inserts bubbles instead */
+/* of fetching, which drains the pipeline. Returns nonzero,  */
+/* without executing the cycle, once a HALT has reached WB,  */
+/* and also if a load or store faults. Wider pipelines are   */
+/* handed to cycleWide, the out-of-order model to cycleOoO,  */
+/* and the in-order pipeline to the variant of cycleScalar   */
+/* chosen for this simulation on its first cycle.            */
+/*************************************************************/
+int cycle(simType *sim, int fetch){
+
+    /* A divergence found by the checker stops the simulation */
+    if (sim->state.fault)
+        return(1);
+
+    if (sim->ooo != NULL)
+        return(cycleOoO(sim, fetch));
+    if (sim->state.width > 1)
+        return(cycleWide(sim, fetch));
+    if (sim->pipeline == NULL)
+        sim->pipeline = selectPipeline(sim);
+    return(sim->pipeline(sim, fetch));
+}
+
+/*************************************************************/
+/* The cycleScalar function is cycle for the in-order        */
+/* pipeline. It is always inlined into the pipeline variants */
+/* with a constant variant, a set of V_ flags, so the        */
+/* compiler drops the tests for the features a variant       */
+/* leaves out, along with the code they guard.               */
+/*************************************************************/
+SPECIALIZE int cycleScalar(simType *sim, int fetch, int variant){
+
+  stateType *statePtr = &sim->state;
+  pipeType *pipe;            /* Pipeline registers before the cycle executes */
+  pipeType *newPipe;         /* Pipeline registers after the cycle executes */
+  decodedType *ifid;         /* Decoded instructions held in the pipeline registers before the cycle */
+  decodedType *idex;
+  decodedType *exmem;
+  decodedType *memwb;
+  decodedType *dec;          /* Decoded instruction being moved into a pipeline register */
+  int newPC;                 /* Program counter after the cycle executes */
+  int target;                /* Predicted branch target */
+  int taken;                 /* Resolved branch direction */
+  int trace;                 /* Nonzero if this cycle is being traced */
+
+
+    pipe = &statePtr->pipe[statePtr->cur];
+    newPipe = &statePtr->pipe[statePtr->cur ^ 1];
+    ifid = &statePtr->decodedMem[pipe->IFID[0].instr];
+    idex = &statePtr->decodedMem[pipe->IDEX[0].instr];
+    exmem = &statePtr->decodedMem[pipe->EXMEM[0].instr];
+    memwb = &statePtr->decodedMem[pipe->MEMWB[0].instr];
+    trace = (variant & V_TRACE) && traceCycle(sim->config, statePtr->cycles + 1);
+
+    if (trace)
+        traceState(sim);
+
+	/* If a halt instruction is entering its WB stage, then all of the legitimate */
+	/* instruction have completed. */
+    if (memwb->op == OP_HALT)
+        return(1);
+
+    /* A load or store that misses in the data cache holds the whole pipeline */
+    /* in place until its line arrives. The cache is accessed once, in the    */
+    /* first cycle the instruction spends in MEM; out-of-range addresses are  */
+    /* left for the MEM stage to fault on.                                    */
+    if ((variant & V_CACHES) && sim->cache[CACHE_L1D].tags != NULL && !statePtr->memDone
+        && (exmem->op == OP_LW || exmem->op == OP_SW)
+        && pipe->EXMEM[0].aluResult >= 0 && pipe->EXMEM[0].aluResult / 4 < statePtr->numDataMem) {
+        statePtr->memStall = cacheAccess(&sim->cache[CACHE_L1D], pipe->EXMEM[0].aluResult, exmem->op == OP_SW);
+        if (variant & V_LANES)
+            laneAccess(sim, CACHE_L1D, pipe->EXMEM[0].aluResult, exmem->op == OP_SW, statePtr->memStall);
+        statePtr->memDone = 1;
+    }
+    if ((variant & V_CACHES) && statePtr->memStall > 0) {
+        if (trace)
+            traceText(sim, "\nMemory Stall\n");
+        VLOGEVENT(sim, EV_STALL, STALL_MEMORY, pipe->EXMEM[0].id, 0);
+        countPipeline(sim, pipe, NULL);
+        statePtr->memStall--;
+        if (statePtr->fetchStall > 0)
+            statePtr->fetchStall--; /* an instruction cache miss keeps going meanwhile */
+        statePtr->cycles++;
+        sim->stats.numMemStalls++;
+        return(0);
+    }
+
+    /* Start from a copy of the pipeline registers only; the memories and the   */
+    /* register file are updated in place. This is safe because every read of  */
+    /* regFile (ID, EX, and the SW data in MEM) happens before WB writes it,    */
+    /* and only one instruction reads or writes dataMem per cycle. At width 1  */
+    /* only slot 0 is used; the other slots stay zero in both copies.          */
+    newPipe->IFID[0] = pipe->IFID[0];
+    newPipe->IDEX[0] = pipe->IDEX[0];
+    newPipe->EXMEM[0] = pipe->EXMEM[0];
+    newPipe->MEMWB[0] = pipe->MEMWB[0];
+
+	/* Modify newPipe stage-by-stage below to reflect the state of the pipeline after the cycle has executed */
+
+    /* --------------------- IF stage --------------------- */
+
+    /* The instruction cache is accessed once per fetch address; a miss */
+    /* makes IF insert bubbles until the line arrives.                  */
+    if (fetch && (variant & V_CACHES) && sim->cache[CACHE_L1I].tags != NULL && !statePtr->fetchDone
+        && statePtr->PC >= 0 && statePtr->PC / 4 < statePtr->numInstrMem) {
+        statePtr->fetchStall = cacheAccess(&sim->cache[CACHE_L1I], statePtr->PC | INSTRSPACE, 0);
+        if (variant & V_LANES)
+            laneAccess(sim, CACHE_L1I, statePtr->PC | INSTRSPACE, 0, statePtr->fetchStall);
+        statePtr->fetchDone = 1;
+    }
+
+    if (!fetch || ((variant & V_CACHES) && statePtr->fetchStall > 0)) {
+
+        /* Draining or waiting for the instruction cache: insert a bubble and hold the PC */
+        memset(&newPipe->IFID[0], 0, sizeof(IFIDType));
+
+        newPC = statePtr->PC;
+
+        if (fetch) {
+
+            if (trace)
+                traceText(sim, "\nFetch Stall\n");
+
+            VLOGEVENT(sim, EV_STALL, STALL_FETCH, 0, statePtr->PC);
+
+            newPipe->IFID[0].cause = CPI_MEMORY;
+
+            statePtr->fetchStall--;
+
+            sim->stats.numFetchStalls++;
+
+        }
+
+    } else {
+
+    statePtr->fetchDone = 0;
+
+    newPC = ((statePtr->PC) + 4);//set the new PC to the old PC plus 4 for next instr 
+    
+    if (statePtr->PC >= 0 && statePtr->PC / 4 < statePtr->numInstrMem)
+        newPipe->IFID[0].instr = DECODEDINDEX(statePtr->PC);//PC divide by 4 since instruction memory is sequential
+    else
+        newPipe->IFID[0].instr = ENDINDEX(statePtr);//fetching outside instruction memory gives a HALT
+    
+    newPipe->IFID[0].PCPlus4 = ((statePtr->PC) + 4);
+
+    newPipe->IFID[0].id = statePtr->nextId;
+
+    newPipe->IFID[0].cause = CPI_BASE;
+
+    /* Follow the predicted path if the branch predictor and BTB say taken */
+    if (variant & V_PREDICT) {
+        newPipe->IFID[0].predTaken = predictBranch(&sim->pred, statePtr->PC, &newPipe->IFID[0].predHist, &target);
+        if (variant & V_LANES)
+            lanePredict(sim, statePtr->PC, newPipe->IFID[0].predTaken, newPipe->IFID[0].predHist,
+                newPipe->IFID[0].predTaken ? target : 0);
+    } else {
+        newPipe->IFID[0].predTaken = 0;
+        newPipe->IFID[0].predHist = sim->pred.history;
+    }
+
+    if (newPipe->IFID[0].predTaken)
+        newPC = target;
+
+    }
+
+    /* --------------------- ID stage --------------------- */   
+
+    if((idex->op == OP_LW) && ((pipe->IDEX[0].rtReg == ifid->rs) || (pipe->IDEX[0].rtReg == ifid->rt))) {
+
+    	if (trace)
+            traceText(sim, "\nStall Pipeline\n");
+
+        VLOGEVENT(sim, EV_STALL, STALL_LOADUSE, pipe->IFID[0].id, 0);
+
+        newPipe->IDEX[0].instr = NOOPINDEX; //flush cycle
+
+        newPipe->IDEX[0].id = 0;
+
+        newPipe->IDEX[0].cause = CPI_HAZARD;
+
+        newPipe->IFID[0] = pipe->IFID[0];
+
+        newPC = statePtr->PC;
+
+        sim->stats.numStalls++;
+
+    } else {
+
+        newPipe->IDEX[0].instr = pipe->IFID[0].instr; 
+
+        newPipe->IDEX[0].id = pipe->IFID[0].id;
+
+        newPipe->IDEX[0].cause = pipe->IFID[0].cause;
+            
+    }
+
+    if(exmem->op != OP_HALT) {
+
+        dec = &statePtr->decodedMem[newPipe->IDEX[0].instr];
+    
+    	newPipe->IDEX[0].PCPlus4 = pipe->IFID[0].PCPlus4;  
+
+    	newPipe->IDEX[0].readData1 = statePtr->regFile[dec->rs];
+                   
+    	newPipe->IDEX[0].readData2 = statePtr->regFile[dec->rt];
+
+    	newPipe->IDEX[0].rsReg = dec->rs;
+                   
+    	newPipe->IDEX[0].rtReg = dec->rt;
+
+    	newPipe->IDEX[0].immed = dec->immed;
+
+    	newPipe->IDEX[0].rdReg = dec->rd; //decoded as 0 for non R-type instructions
+                   
+    	newPipe->IDEX[0].branchTarget = pipe->IFID[0].PCPlus4 + (dec->immed << 2);
+
+    	newPipe->IDEX[0].predTaken = pipe->IFID[0].predTaken;
+
+    	newPipe->IDEX[0].predHist = pipe->IFID[0].predHist;
+
+    }
+
+    /* --------------------- EX stage --------------------- */
+
+    /* Forwarding unit. ADD and SUB results are forwarded from EX/MEM, and   */
+    /* ADD, SUB and LW results from MEM/WB, whose write-back happens after   */
+    /* ID has read the register file. A load in EX/MEM never needs to be     */
+    /* forwarded because the load-use stall keeps its consumer out of EX.    */
+    int exmemWrite = (exmem->op == OP_ADD || exmem->op == OP_SUB);
+
+    int memwbWrite = (memwb->op == OP_ADD || memwb->op == OP_SUB || memwb->op == OP_LW);
+
+    int memwbData = (memwb->op == OP_LW) ? pipe->MEMWB[0].writeDataMem : pipe->MEMWB[0].writeDataALU;
+
+    if(exmemWrite && (pipe->EXMEM[0].writeReg == pipe->IDEX[0].rsReg)) {
+    	
+    	if (trace)
+            traceText(sim, "\n(1a) ForwardA = 10\n");
+
+        VLOGEVENT(sim, EV_FORWARD, FWD_EXMEM_A, pipe->IDEX[0].id, pipe->EXMEM[0].id);
+
+        sim->stats.forwards[FWD_EXMEM_A]++;
+
+    	pipe->IDEX[0].readData1 = pipe->EXMEM[0].aluResult;
+
+    } else if(memwbWrite && (pipe->MEMWB[0].writeReg == pipe->IDEX[0].rsReg)) {
+    
+        if (trace)
+            traceText(sim, "\n(2a) ForwardA = 01\n");
+
+        VLOGEVENT(sim, EV_FORWARD, FWD_MEMWB_A, pipe->IDEX[0].id, pipe->MEMWB[0].id);
+
+        sim->stats.forwards[FWD_MEMWB_A]++;
+
+        pipe->IDEX[0].readData1 = memwbData;
+
+    }
+
+    if(exmemWrite && (pipe->EXMEM[0].writeReg == pipe->IDEX[0].rtReg)) {
+    
+    	if (trace)
+            traceText(sim, "\n(1b) ForwardB = 10\n");
+
+        VLOGEVENT(sim, EV_FORWARD, FWD_EXMEM_B, pipe->IDEX[0].id, pipe->EXMEM[0].id);
+
+        sim->stats.forwards[FWD_EXMEM_B]++;
+
+    	pipe->IDEX[0].readData2 = pipe->EXMEM[0].aluResult;
+
+    } else if(memwbWrite && (pipe->MEMWB[0].writeReg == pipe->IDEX[0].rtReg)) {
+    
+        if (trace)
+            traceText(sim, "\n(2b) ForwardB = 01\n");
+
+        VLOGEVENT(sim, EV_FORWARD, FWD_MEMWB_B, pipe->IDEX[0].id, pipe->MEMWB[0].id);
+
+        sim->stats.forwards[FWD_MEMWB_B]++;
+
+        pipe->IDEX[0].readData2 = memwbData;
+    
+    }
+
+    newPipe->EXMEM[0].instr = pipe->IDEX[0].instr;
+
+    newPipe->EXMEM[0].id = pipe->IDEX[0].id;
+
+    newPipe->EXMEM[0].cause = pipe->IDEX[0].cause;
+
+        switch(idex->op) {
+
+            case OP_LW:
+
+                newPipe->EXMEM[0].writeReg = idex->rt;
+
+                newPipe->EXMEM[0].writeDataReg = statePtr->regFile[idex->rt];
+
+                newPipe->EXMEM[0].aluResult = ((pipe->IDEX[0].readData1) + (pipe->IDEX[0].immed));
+
+                break;
+
+            case OP_SW:
+                
+                newPipe->EXMEM[0].writeReg = idex->rt;
+
+                newPipe->EXMEM[0].writeDataReg = idex->rt;//statePtr->regFile[idex->rt];
+
+                newPipe->EXMEM[0].aluResult = ((pipe->IDEX[0].readData1) + (pipe->IDEX[0].immed));
+
+                break;
+
+            case OP_BNE:
+
+                newPipe->EXMEM[0].writeReg = idex->rt;
+
+                newPipe->EXMEM[0].writeDataReg = pipe->IDEX[0].readData2;
+
+                newPipe->EXMEM[0].aluResult = ((pipe->IDEX[0].readData1) - (pipe->IDEX[0].readData2));
+
+                /* Resolve the branch and check the prediction made in IF. On a      */
+                /* misprediction, the two younger instructions (in IF and ID this    */
+                /* cycle) are squashed and fetch restarts on the correct path.       */
+                taken = (newPipe->EXMEM[0].aluResult != 0);
+
+                if (variant & V_PREDICT) {
+                    updatePredictor(&sim->pred, pipe->IDEX[0].PCPlus4 - 4, pipe->IDEX[0].predHist, taken,
+                        pipe->IDEX[0].branchTarget);
+                    if (variant & V_LANES)
+                        laneUpdate(sim, pipe->IDEX[0].PCPlus4 - 4, pipe->IDEX[0].predHist, taken,
+                            pipe->IDEX[0].branchTarget);
+                }
+
+                sim->stats.numBranches++;
+
+                VLOGEVENT(sim, EV_BRANCH, taken | (taken != pipe->IDEX[0].predTaken) << 1, pipe->IDEX[0].id, 0);
+
+                if(taken != pipe->IDEX[0].predTaken) {
+
+                	if (trace)
+                        traceText(sim, "\nBranch Mispredicted\n");
+
+                	sim->stats.numFlushed += (newPipe->IFID[0].instr != NOOPINDEX) + (newPipe->IDEX[0].instr != NOOPINDEX);
+
+                	memset(&newPipe->IFID[0], 0, sizeof(IFIDType));
+
+                	memset(&newPipe->IDEX[0], 0, sizeof(IDEXType));
+
+                	newPipe->IFID[0].cause = newPipe->IDEX[0].cause = CPI_BRANCH;
+
+                	newPC = taken ? pipe->IDEX[0].branchTarget : pipe->IDEX[0].PCPlus4;
+
+                	/* Abandon any instruction cache miss on the wrong path */
+                	statePtr->fetchStall = 0;
+
+                	statePtr->fetchDone = 0;
+
+                	sim->stats.numMisPred++;
+
+                }
+
+                break;
+
+            case OP_HALT:
+
+            	newPipe->EXMEM[0].writeReg = 0;
+
+            	newPipe->EXMEM[0].writeDataReg = 0;
+
+            	newPipe->EXMEM[0].aluResult = 0;
+
+            	break;
+
+            case OP_ADD:
+
+                newPipe->EXMEM[0].writeReg = idex->rd;
+
+                newPipe->EXMEM[0].writeDataReg = idex->rt;
+
+                newPipe->EXMEM[0].aluResult = (pipe->IDEX[0].readData1) + (pipe->IDEX[0].readData2);
+
+                break;
+
+            case OP_SUB:
+
+                newPipe->EXMEM[0].writeReg = idex->rd;
+
+                newPipe->EXMEM[0].writeDataReg = idex->rt;
+
+                newPipe->EXMEM[0].aluResult = (pipe->IDEX[0].readData1) - (pipe->IDEX[0].readData2);
+
+                break;
+
+            case OP_NOOP:
+
+                newPipe->EXMEM[0].writeReg = idex->rd;
+
+                newPipe->EXMEM[0].writeDataReg = idex->rt;
+
+                break;
+
+        }
+
+    /* --------------------- MEM stage --------------------- */
+
+    newPipe->MEMWB[0].instr = pipe->EXMEM[0].instr;
+
+    newPipe->MEMWB[0].id = pipe->EXMEM[0].id;
+
+    newPipe->MEMWB[0].cause = pipe->EXMEM[0].cause;
+ 
+    switch(exmem->op) {
+    	
+    	case OP_LW:
+    	    
+    	    newPipe->MEMWB[0].writeDataALU = pipe->EXMEM[0].aluResult;
+
+    		newPipe->MEMWB[0].writeReg = pipe->EXMEM[0].writeReg;
+
+    		if (checkDataAddr(statePtr, pipe->EXMEM[0].aluResult))
+    		    return(1);
+
+    		newPipe->MEMWB[0].writeDataMem = LOADDATA(&statePtr->dataMem[((pipe->EXMEM[0].aluResult) / 4)]);
+    	
+    		break;
+    	
+    	case OP_SW:
+    	    
+    	    newPipe->MEMWB[0].writeDataALU = pipe->EXMEM[0].aluResult;
+
+    		newPipe->MEMWB[0].writeReg = pipe->EXMEM[0].writeReg;
+
+				if (checkDataAddr(statePtr, pipe->EXMEM[0].aluResult))
+			    return(1);
+
+				if ((variant & V_HOOKS) && sim->history != NULL)
+				    logStore(sim, pipe->EXMEM[0].aluResult, statePtr->regFile[pipe->EXMEM[0].writeReg]);
+
+				STOREDATA(&statePtr->dataMem[(((pipe->EXMEM[0].aluResult) / 4))], statePtr->regFile[pipe->EXMEM[0].writeReg]);
+
+				if ((variant & V_HOOKS) && sim->written != NULL)
+				    logWrite(sim, pipe->EXMEM[0].aluResult);
+            
+            break;
+
+        case OP_HALT:
+
+        	newPipe->MEMWB[0].writeDataALU = 0;
+
+        	newPipe->MEMWB[0].writeReg = 0;
+	
+				break;
+
+			case OP_BNE:
+
+				newPipe->MEMWB[0].writeDataALU = pipe->EXMEM[0].aluResult;
+
+				newPipe->MEMWB[0].writeReg = pipe->EXMEM[0].writeReg;
+
+				newPipe->MEMWB[0].writeDataMem = pipe->EXMEM[0].writeDataReg;
+
+				break;
+    	
+    	case OP_ADD:
+    	case OP_SUB:
+
+    		newPipe->MEMWB[0].writeDataALU = pipe->EXMEM[0].aluResult;
+
+    		newPipe->MEMWB[0].writeReg = pipe->EXMEM[0].writeReg;
+
+    		break;
+
+    	case OP_NOOP:
+
+    		break;
+    
+    }
+
+    /* --------------------- WB stage --------------------- */
+
+    switch(exmem->op) { /* the instruction that just moved into newPipe->MEMWB[0] */
+
+    	case OP_LW:
+
+    		statePtr->regFile[newPipe->MEMWB[0].writeReg] = newPipe->MEMWB[0].writeDataMem;
+
+    		break;
+
+    	case OP_HALT:
+    	case OP_NOOP:
+
+    		newPipe->MEMWB[0].writeDataALU = 0;
+    			
+    			newPipe->MEMWB[0].writeReg = 0;
+
+    		break;
+
+    	case OP_ADD:
+    	case OP_SUB:
+
+    		newPipe->MEMWB[0].writeReg = exmem->rd; 
+
+    		statePtr->regFile[newPipe->MEMWB[0].writeReg] = newPipe->MEMWB[0].writeDataALU;
+
+    		break;
+
+    }
+
+
+
+    /* Count instructions as they retire, not counting HALT or bubbles */
+    if (newPipe->MEMWB[0].instr != NOOPINDEX && exmem->op != OP_HALT) {
+        sim->stats.instructions++;
+        if ((variant & V_HOOKS) && sim->checker != NULL)
+            logRetire(sim, DECODEDPC(newPipe->MEMWB[0].instr), exmem->op,
+                newPipe->MEMWB[0].writeReg, newPipe->MEMWB[0].writeDataALU);
+    }
+
+    countPipeline(sim, pipe, newPipe);
+
+    if ((variant & V_HOOKS) && sim->timeline != NULL)
+        logPipeline(sim, pipe, newPipe);
+
+    /* Number the next fetch after the instruction fetched this cycle, unless it was discarded */
+    if (newPipe->IFID[0].id == statePtr->nextId)
+        statePtr->nextId++;
+
+    /* The new pipeline registers become the current ones before we execute the next cycle */
+    statePtr->PC = newPC;
+    statePtr->cur ^= 1;
+    statePtr->cycles++;
+    statePtr->memDone = 0;
+
+    return(0);
+
+}
+
+/* The pipeline variants: cycleScalar with each set of V_ flags */
+#define VARIANT(v) int cycleVariant##v(simType *sim, int fetch){ return(cycleScalar(sim, fetch, v)); }
+VARIANT(0)  VARIANT(1)  VARIANT(2)  VARIANT(3)  VARIANT(4)  VARIANT(5)  VARIANT(6)  VARIANT(7)
+VARIANT(8)  VARIANT(9)  VARIANT(10) VARIANT(11) VARIANT(12) VARIANT(13) VARIANT(14) VARIANT(15)
+VARIANT(16) VARIANT(17) VARIANT(18) VARIANT(19) VARIANT(20) VARIANT(21) VARIANT(22) VARIANT(23)
+VARIANT(24) VARIANT(25) VARIANT(26) VARIANT(27) VARIANT(28) VARIANT(29) VARIANT(30) VARIANT(31)
+#undef VARIANT
+
+/*************************************************************/
+/* The selectPipeline function returns the pipeline variant  */
+/* with the features this simulation uses. They must not     */
+/* change once it has started cycling.                       */
+/*************************************************************/
+cycleFnType selectPipeline(simType *sim)
+{
+    static const cycleFnType variants[NUMVARIANTS] = {
+        cycleVariant0, cycleVariant1, cycleVariant2, cycleVariant3,
+        cycleVariant4, cycleVariant5, cycleVariant6, cycleVariant7,
+        cycleVariant8, cycleVariant9, cycleVariant10, cycleVariant11,
+        cycleVariant12, cycleVariant13, cycleVariant14, cycleVariant15,
+        cycleVariant16, cycleVariant17, cycleVariant18, cycleVariant19,
+        cycleVariant20, cycleVariant21, cycleVariant22, cycleVariant23,
+        cycleVariant24, cycleVariant25, cycleVariant26, cycleVariant27,
+        cycleVariant28, cycleVariant29, cycleVariant30, cycleVariant31
+    };
+    int variant = 0;
+
+    if (sim->tracer != NULL)
+        variant |= V_TRACE;
+    if (sim->cache[CACHE_L1I].tags != NULL || sim->cache[CACHE_L1D].tags != NULL
+        || sim->state.memStall > 0 || sim->state.fetchStall > 0)
+        variant |= V_CACHES;
+    if (sim->pred.type != BP_NOTTAKEN)
+        variant |= V_PREDICT;
+    if (sim->timeline != NULL || sim->checker != NULL || sim->written != NULL || sim->history != NULL)
+        variant |= V_HOOKS;
+    if (sim->lockstep != NULL)
+        variant |= V_LANES;
+    return(variants[variant]);
+}
+
+/*************************************************************/
+/* The cycleWide function is cycle for issue widths above 1. */
+/* Each pipeline register holds a group of up to width       */
+/* instructions, oldest in slot 0, that move through the     */
+/* stages together. IF fetches a group of sequential         */
+/* instructions, ending it after a predicted-taken branch.   */
+/* ID issues the longest prefix of its group that has no     */
+/* load-use hazard on a load in ID/EX, no dependence on an   */
+/* older instruction in the same group (their results are   */
+/* not ready until the end of EX) and at most one load or    */
+/* store, since there is one data memory port; HALT ends a   */
+/* group. Instructions that do not issue stay in IF/ID and   */
+/* IF does not fetch. EX forwards from the youngest producer */
+/* in EX/MEM, then MEM/WB, and a mispredicted branch         */
+/* squashes the younger instructions in its own group as     */
+/* well as IF and ID. MEM and WB handle the slots in order,  */
+/* so a store sees the results of older instructions in its  */
+/* group.                                                    */
+/*************************************************************/
+int cycleWide(simType *sim, int fetch){
+
+  stateType *statePtr = &sim->state;
+  decodedType *decodedMem = statePtr->decodedMem;
+  pipeType *pipe;            /* Pipeline registers before the cycle executes */
+  pipeType *newPipe;         /* Pipeline registers after the cycle executes */
+  decodedType *dec;          /* Decoded instruction in the slot being handled */
+  decodedType *older;        /* Decoded older instruction it may depend on */
+  int width = statePtr->width;
+  int newPC;                 /* Program counter after the cycle executes */
+  int pc;                    /* Address of the instruction being fetched */
+  int target;                /* Predicted branch target */
+  int taken;                 /* Resolved branch direction */
+  int trace;                 /* Nonzero if this cycle is being traced */
+  int issued;                /* Instructions issued from IF/ID */
+  int waiting;               /* Instructions held in IF/ID */
+  int memOps;                /* Loads and stores in the issue group */
+  int memSlot;               /* Slot of the load or store in EX/MEM, -1 if none */
+  int squash;                /* Nonzero once a branch in EX has mispredicted */
+  int i, j, reg;
+
+
+    pipe = &statePtr->pipe[statePtr->cur];
+    newPipe = &statePtr->pipe[statePtr->cur ^ 1];
+    trace = traceCycle(sim->config, statePtr->cycles + 1);
+
+    if (trace)
+        traceState(sim);
+
+    for (i = 0; i < width; i++)
+        if (decodedMem[pipe->MEMWB[i].instr].op == OP_HALT)
+            return(1);
+
+    /* The data cache, as in cycle; a group holds at most one load or store */
+    for (memSlot = -1, i = 0; i < width; i++)
+        if (decodedMem[pipe->EXMEM[i].instr].op == OP_LW || decodedMem[pipe->EXMEM[i].instr].op == OP_SW)
+            memSlot = i;
+    if (sim->cache[CACHE_L1D].tags != NULL && !statePtr->memDone && memSlot >= 0
+        && pipe->EXMEM[memSlot].aluResult >= 0 && pipe->EXMEM[memSlot].aluResult / 4 < statePtr->numDataMem) {
+        statePtr->memStall = cacheAccess(&sim->cache[CACHE_L1D], pipe->EXMEM[memSlot].aluResult,
+            decodedMem[pipe->EXMEM[memSlot].instr].op == OP_SW);
+        statePtr->memDone = 1;
+    }
+    if (statePtr->memStall > 0) {
+        if (trace)
+            traceText(sim, "\nMemory Stall\n");
+        LOGEVENT(sim, EV_STALL, STALL_MEMORY, pipe->EXMEM[memSlot].id, 0);
+        countPipeline(sim, pipe, NULL);
+        statePtr->memStall--;
+        if (statePtr->fetchStall > 0)
+            statePtr->fetchStall--;
+        statePtr->cycles++;
+        sim->stats.numMemStalls++;
+        return(0);
+    }
+
+    *newPipe = *pipe;
+    newPC = statePtr->PC;
+
+    /* --------------------- ID stage --------------------- */
+
+    memOps = 0;
+    for (issued = 0; issued < width; issued++) {
+        dec = &decodedMem[pipe->IFID[issued].instr];
+        if (dec->op == OP_NOOP)
+            continue;
+        for (j = 0; j < width; j++)
+            if (decodedMem[pipe->IDEX[j].instr].op == OP_LW
+                && (pipe->IDEX[j].rtReg == dec->rs || pipe->IDEX[j].rtReg == dec->rt))
+                break;
+        if (j < width) {
+            if (trace)
+                traceText(sim, "\nStall Pipeline\n");
+            LOGEVENT(sim, EV_STALL, STALL_LOADUSE, pipe->IFID[issued].id, 0);
+            sim->stats.numStalls++;
+            break;
+        }
+        for (j = 0; j < issued; j++) {
+            older = &decodedMem[pipe->IFID[j].instr];
+            reg = older->op == OP_LW ? older->rt : older->rd;
+            if ((older->op == OP_ADD || older->op == OP_SUB || older->op == OP_LW)
+                && (reg == dec->rs || reg == dec->rt))
+                break;
+        }
+        if (j < issued) {
+            if (trace)
+                traceText(sim, "\nSplit Group (dependence)\n");
+            LOGEVENT(sim, EV_STALL, STALL_DEPEND, pipe->IFID[issued].id, 0);
+            sim->stats.numDepSplits++;
+            break;
+        }
+        if ((dec->op == OP_LW || dec->op == OP_SW) && memOps++ > 0) {
+            if (trace)
+                traceText(sim, "\nSplit Group (memory port)\n");
+            LOGEVENT(sim, EV_STALL, STALL_PORT, pipe->IFID[issued].id, 0);
+            sim->stats.numPortSplits++;
+            break;
+        }
+        if (dec->op == OP_HALT) {
+            issued++;
+            break;
+        }
+    }
+
+    for (i = 0; i < width; i++) {
+        if (i >= issued) {
+            memset(&newPipe->IDEX[i], 0, sizeof(IDEXType));
+            newPipe->IDEX[i].cause = pipe->IFID[i].instr != NOOPINDEX ? CPI_HAZARD : pipe->IFID[i].cause;
+            continue;
+        }
+        dec = &decodedMem[pipe->IFID[i].instr];
+        newPipe->IDEX[i].instr = pipe->IFID[i].instr;
+        newPipe->IDEX[i].PCPlus4 = pipe->IFID[i].PCPlus4;
+        newPipe->IDEX[i].readData1 = statePtr->regFile[dec->rs];
+        newPipe->IDEX[i].readData2 = statePtr->regFile[dec->rt];
+        newPipe->IDEX[i].rsReg = dec->rs;
+        newPipe->IDEX[i].rtReg = dec->rt;
+        newPipe->IDEX[i].immed = dec->immed;
+        newPipe->IDEX[i].rdReg = dec->rd;
+        newPipe->IDEX[i].branchTarget = pipe->IFID[i].PCPlus4 + (dec->immed << 2);
+        newPipe->IDEX[i].predTaken = pipe->IFID[i].predTaken;
+        newPipe->IDEX[i].predHist = pipe->IFID[i].predHist;
+        newPipe->IDEX[i].id = pipe->IFID[i].id;
+        newPipe->IDEX[i].cause = pipe->IFID[i].cause;
+    }
+
+    /* Move the instructions that did not issue to the front of IF/ID */
+    for (waiting = 0, i = issued; i < width; i++)
+        if (pipe->IFID[i].instr != NOOPINDEX)
+            newPipe->IFID[waiting++] = pipe->IFID[i];
+    for (i = waiting; i < width; i++) {
+        memset(&newPipe->IFID[i], 0, sizeof(IFIDType));
+        if (waiting > 0)
+            newPipe->IFID[i].cause = CPI_HAZARD;
+    }
+
+    /* --------------------- IF stage --------------------- */
+
+    if (waiting == 0 && fetch && sim->cache[CACHE_L1I].tags != NULL && !statePtr->fetchDone
+        && statePtr->PC >= 0 && statePtr->PC / 4 < statePtr->numInstrMem) {
+        statePtr->fetchStall = cacheAccess(&sim->cache[CACHE_L1I], statePtr->PC | INSTRSPACE, 0);
+        statePtr->fetchDone = 1;
+    }
+
+    if (waiting > 0) {
+
+        /* IF/ID is still occupied: hold the PC */
+
+    } else if (!fetch || statePtr->fetchStall > 0) {
+
+        if (fetch) {
+            if (trace)
+                traceText(sim, "\nFetch Stall\n");
+            LOGEVENT(sim, EV_STALL, STALL_FETCH, 0, statePtr->PC);
+            for (i = 0; i < width; i++)
+                newPipe->IFID[i].cause = CPI_MEMORY;
+            statePtr->fetchStall--;
+            sim->stats.numFetchStalls++;
+        }
+
+    } else {
+
+        statePtr->fetchDone = 0;
+        for (pc = statePtr->PC, i = 0; i < width; i++) {
+            if (pc >= 0 && pc / 4 < statePtr->numInstrMem)
+                newPipe->IFID[i].instr = DECODEDINDEX(pc);
+            else
+                newPipe->IFID[i].instr = ENDINDEX(statePtr);
+            newPipe->IFID[i].PCPlus4 = pc + 4;
+            newPipe->IFID[i].id = statePtr->nextId + i;
+            newPipe->IFID[i].predTaken = predictBranch(&sim->pred, pc, &newPipe->IFID[i].predHist, &target);
+            pc = newPipe->IFID[i].predTaken ? target : pc + 4;
+            if (newPipe->IFID[i].predTaken)
+                break;
+        }
+        for (i++; i < width; i++)
+            newPipe->IFID[i].cause = CPI_BRANCH; /* the rest of a group ended by a taken branch */
+        newPC = pc;
+
+    }
+
+    /* --------------------- EX stage --------------------- */
+
+    squash = 0;
+    for (i = 0; i < width; i++) {
+        IDEXType *idex = &pipe->IDEX[i];
+        EXMEMType *exmem = &newPipe->EXMEM[i];
+
+        dec = &decodedMem[idex->instr];
+        if (squash) {
+            sim->stats.numFlushed += idex->instr != NOOPINDEX;
+            memset(exmem, 0, sizeof(EXMEMType));
+            exmem->cause = CPI_BRANCH;
+            continue;
+        }
+
+        /* Forward from the youngest producer: EX/MEM slots, then MEM/WB slots, newest first */
+        for (j = 2 * width - 1; j >= 0; j--) {
+            int fromExmem = j >= width;
+            int slot = j % width;
+            older = &decodedMem[fromExmem ? pipe->EXMEM[slot].instr : pipe->MEMWB[slot].instr];
+            reg = fromExmem ? pipe->EXMEM[slot].writeReg : pipe->MEMWB[slot].writeReg;
+            if (!(older->op == OP_ADD || older->op == OP_SUB || (!fromExmem && older->op == OP_LW))
+                || reg != idex->rsReg)
+                continue;
+            if (trace)
+                traceText(sim, fromExmem ? "\n(1a) ForwardA = 10\n" : "\n(2a) ForwardA = 01\n");
+            LOGEVENT(sim, EV_FORWARD, fromExmem ? FWD_EXMEM_A : FWD_MEMWB_A, idex->id,
+                fromExmem ? pipe->EXMEM[slot].id : pipe->MEMWB[slot].id);
+            sim->stats.forwards[fromExmem ? FWD_EXMEM_A : FWD_MEMWB_A]++;
+            idex->readData1 = fromExmem ? pipe->EXMEM[slot].aluResult
+                : (older->op == OP_LW ? pipe->MEMWB[slot].writeDataMem : pipe->MEMWB[slot].writeDataALU);
+            break;
+        }
+        for (j = 2 * width - 1; j >= 0; j--) {
+            int fromExmem = j >= width;
+            int slot = j % width;
+            older = &decodedMem[fromExmem ? pipe->EXMEM[slot].instr : pipe->MEMWB[slot].instr];
+            reg = fromExmem ? pipe->EXMEM[slot].writeReg : pipe->MEMWB[slot].writeReg;
+            if (!(older->op == OP_ADD || older->op == OP_SUB || (!fromExmem && older->op == OP_LW))
+                || reg != idex->rtReg)
+                continue;
+            if (trace)
+                traceText(sim, fromExmem ? "\n(1b) ForwardB = 10\n" : "\n(2b) ForwardB = 01\n");
+            LOGEVENT(sim, EV_FORWARD, fromExmem ? FWD_EXMEM_B : FWD_MEMWB_B, idex->id,
+                fromExmem ? pipe->EXMEM[slot].id : pipe->MEMWB[slot].id);
+            sim->stats.forwards[fromExmem ? FWD_EXMEM_B : FWD_MEMWB_B]++;
+            idex->readData2 = fromExmem ? pipe->EXMEM[slot].aluResult
+                : (older->op == OP_LW ? pipe->MEMWB[slot].writeDataMem : pipe->MEMWB[slot].writeDataALU);
+            break;
+        }
+
+        exmem->instr = idex->instr;
+        exmem->id = idex->id;
+        exmem->cause = idex->cause;
+        exmem->writeReg = ISRTYPE(dec->op) ? dec->rd : dec->rt;
+        exmem->writeDataReg = idex->readData2;
+        switch (dec->op) {
+            case OP_LW:
+            case OP_SW:
+                exmem->aluResult = idex->readData1 + idex->immed;
+                break;
+            case OP_ADD:
+                exmem->aluResult = idex->readData1 + idex->readData2;
+                break;
+            case OP_SUB:
+            case OP_BNE:
+                exmem->aluResult = idex->readData1 - idex->readData2;
+                break;
+            default:
+                exmem->aluResult = 0;
+                break;
+        }
+
+        if (dec->op == OP_BNE) {
+            taken = (exmem->aluResult != 0);
+            updatePredictor(&sim->pred, idex->PCPlus4 - 4, idex->predHist, taken, idex->branchTarget);
+            sim->stats.numBranches++;
+            LOGEVENT(sim, EV_BRANCH, taken | (taken != idex->predTaken) << 1, idex->id, 0);
+            if (taken != idex->predTaken) {
+                if (trace)
+                    traceText(sim, "\nBranch Mispredicted\n");
+                for (j = 0; j < width; j++)
+                    sim->stats.numFlushed += (newPipe->IFID[j].instr != NOOPINDEX) + (newPipe->IDEX[j].instr != NOOPINDEX);
+                memset(newPipe->IFID, 0, sizeof(newPipe->IFID));
+                memset(newPipe->IDEX, 0, sizeof(newPipe->IDEX));
+                for (j = 0; j < width; j++)
+                    newPipe->IFID[j].cause = newPipe->IDEX[j].cause = CPI_BRANCH;
+                newPC = taken ? idex->branchTarget : idex->PCPlus4;
+                statePtr->fetchStall = 0;
+                statePtr->fetchDone = 0;
+                sim->stats.numMisPred++;
+                squash = 1;
+            }
+        }
+    }
+
+    /* --------------------- MEM and WB stages --------------------- */
+
+    for (i = 0; i < width; i++) {
+        EXMEMType *exmem = &pipe->EXMEM[i];
+        MEMWBType *memwb = &newPipe->MEMWB[i];
+
+        dec = &decodedMem[exmem->instr];
+        memwb->instr = exmem->instr;
+        memwb->id = exmem->id;
+        memwb->cause = exmem->cause;
+        memwb->writeDataALU = exmem->aluResult;
+        memwb->writeReg = exmem->writeReg;
+        memwb->writeDataMem = 0;
+        switch (dec->op) {
+            case OP_LW:
+                if (checkDataAddr(statePtr, exmem->aluResult))
+                    return(1);
+                memwb->writeDataMem = LOADDATA(&statePtr->dataMem[exmem->aluResult / 4]);
+                statePtr->regFile[memwb->writeReg] = memwb->writeDataMem;
+                break;
+            case OP_SW:
+                if (checkDataAddr(statePtr, exmem->aluResult))
+                    return(1);
+                if (sim->history != NULL)
+                    logStore(sim, exmem->aluResult, statePtr->regFile[exmem->writeReg]);
+                STOREDATA(&statePtr->dataMem[exmem->aluResult / 4], statePtr->regFile[exmem->writeReg]);
+                if (sim->written != NULL)
+                    logWrite(sim, exmem->aluResult);
+                break;
+            case OP_ADD:
+            case OP_SUB:
+                statePtr->regFile[memwb->writeReg] = memwb->writeDataALU;
+                break;
+        }
+        if (exmem->instr != NOOPINDEX && dec->op != OP_HALT) {
+            sim->stats.instructions++;
+            if (sim->checker != NULL)
+                logRetire(sim, DECODEDPC(exmem->instr), dec->op, memwb->writeReg, exmem->aluResult);
+        }
+    }
+
+    countPipeline(sim, pipe, newPipe);
+    if (sim->timeline != NULL)
+        logPipeline(sim, pipe, newPipe);
+    for (i = 0; i < width; i++)
+        if (newPipe->IFID[i].id >= statePtr->nextId)
+            statePtr->nextId = newPipe->IFID[i].id + 1;
+
+    statePtr->PC = newPC;
+    statePtr->cur ^= 1;
+    statePtr->cycles++;
+    statePtr->memDone = 0;
+
+    return(0);
+
+}
+
+/*************************************************************/
+/* The countPipeline function updates the counters at the    */
+/* end of an in-order cycle: the occupancy of the pipeline   */
+/* registers read by the cycle (pipe), and the CPI stack and */
+/* opcode counts from the instructions written back (those   */
+/* entering newPipe's MEM/WB). An empty MEM/WB slot is       */
+/* charged to the cause its bubble was created with. In a    */
+/* cycle frozen by a data cache miss, newPipe is NULL and    */
+/* every slot is charged to memory.                          */
+/*************************************************************/
+void countPipeline(simType *sim, pipeType *pipe, pipeType *newPipe)
+{
+    statsType *stats = &sim->stats;
+    decodedType *decodedMem = sim->state.decodedMem;
+    int width = sim->state.width;
+    int i;
+
+    for (i = 0; i < width; i++) {
+        stats->busy[0] += pipe->IFID[i].instr != NOOPINDEX;
+        stats->busy[1] += pipe->IDEX[i].instr != NOOPINDEX;
+        stats->busy[2] += pipe->EXMEM[i].instr != NOOPINDEX;
+        stats->busy[3] += pipe->MEMWB[i].instr != NOOPINDEX;
+        if (newPipe == NULL) {
+            stats->cpiSlots[CPI_MEMORY]++;
+        } else if (newPipe->MEMWB[i].instr != NOOPINDEX) {
+            stats->cpiSlots[CPI_BASE]++;
+            stats->opCounts[decodedMem[newPipe->MEMWB[i].instr].op]++;
+        } else {
+            stats->cpiSlots[newPipe->MEMWB[i].cause]++;
+        }
+    }
+}
+
+/*************************************************************/
+/* The initOoO function allocates the out-of-order back end  */
+/* with the configured sizes. Every architectural register   */
+/* starts out held in regFile and every rename register free. */
+/*************************************************************/
+void initOoO(oooType *ooo, configType *config)
+{
+    int i;
+
+    memset(ooo, 0, sizeof(*ooo));
+    ooo->robSize = config->robSize;
+    ooo->iqSize = config->iqSize;
+    ooo->lsqSize = config->lsqSize;
+    ooo->numPregs = config->physRegs;
+    ooo->rob = calloc(ooo->robSize, sizeof(robEntryType));
+    ooo->pregValue = calloc(ooo->numPregs, sizeof(int));
+    ooo->pregReady = calloc(ooo->numPregs, 1);
+    ooo->freeList = malloc(sizeof(int) * ooo->numPregs);
+    for (i = 0; i < ooo->numPregs; i++)
+        ooo->freeList[i] = i;
+    ooo->numFree = ooo->numPregs;
+    for (i = 0; i < NUMREGS; i++)
+        ooo->map[i] = -1;
+}
+
+void freeOoO(oooType *ooo)
+{
+    free(ooo->rob);
+    free(ooo->pregValue);
+    free(ooo->pregReady);
+    free(ooo->freeList);
+}
+
+/*************************************************************/
+/* The squashYounger function removes every reorder buffer   */
+/* entry after the first keep entries, returning their       */
+/* resources, rebuilds the rename map from the entries that  */
+/* are left and empties the fetch queue.                     */
+/*************************************************************/
+void squashYounger(simType *sim, int keep)
+{
+    oooType *ooo = sim->ooo;
+    robEntryType *e;
+    decodedType *dec;
+    int i;
+
+    for (i = keep; i < ooo->robCount; i++) {
+        e = &ooo->rob[(ooo->robHead + i) % ooo->robSize];
+        dec = &sim->state.decodedMem[e->instr];
+        LOGEVENT(sim, EV_FLUSH, 0, e->id, 0);
+        sim->stats.numFlushed++;
+        if (e->dest >= 0)
+            ooo->freeList[ooo->numFree++] = e->dest;
+        if (e->status == ROB_WAITING)
+            ooo->iqCount--;
+        if (dec->op == OP_LW || dec->op == OP_SW)
+            ooo->lsqCount--;
+    }
+    ooo->robCount = keep;
+
+    for (i = 0; i < NUMREGS; i++)
+        ooo->map[i] = -1;
+    for (i = 0; i < ooo->robCount; i++) {
+        e = &ooo->rob[(ooo->robHead + i) % ooo->robSize];
+        dec = &sim->state.decodedMem[e->instr];
+        if (e->dest >= 0)
+            ooo->map[dec->op == OP_LW ? dec->rt : dec->rd] = e->dest;
+    }
+    for (i = 0; i < ooo->fqCount; i++)
+        LOGEVENT(sim, EV_FLUSH, 0, ooo->fetchQueue[(ooo->fqHead + i) % (2 * MAXWIDTH)].id, 0);
+    sim->stats.numFlushed += ooo->fqCount;
+    ooo->fqCount = 0;
+}
+
+/*************************************************************/
+/* The cycleOoO function is cycle for the out-of-order back  */
+/* end. Each cycle, working from the back of the machine to  */
+/* the front:                                                */
+/*   commit retires up to width finished instructions from   */
+/*     the head of the reorder buffer in program order,      */
+/*     writing regFile and dataMem and training the branch   */
+/*     predictor; loads and stores fault here, precisely;    */
+/*   complete makes the results whose latency has elapsed    */
+/*     available and wakes up the instructions waiting on    */
+/*     them;                                                 */
+/*   issue starts up to width ready instructions, oldest     */
+/*     first. A load waits until every older store has its  */
+/*     address and takes its value from the youngest older   */
+/*     store to the same word, else from the data cache. A   */
+/*     mispredicted branch squashes everything younger and   */
+/*     redirects fetch;                                      */
+/*   dispatch renames up to width instructions from the      */
+/*     fetch queue into the reorder buffer, stalling when    */
+/*     the reorder buffer, issue queue, load/store queue or  */
+/*     rename registers are full;                            */
+/*   fetch fills the fetch queue along the predicted path.   */
+/* ALU operations and branches take one cycle, loads one     */
+/* cycle plus any data cache miss; stores write the cache at */
+/* commit. Returns nonzero, without executing the cycle,     */
+/* once a HALT reaches the head of the reorder buffer, and   */
+/* also if a committing load or store faults.                */
+/*************************************************************/
+int cycleOoO(simType *sim, int fetch){
+
+  stateType *statePtr = &sim->state;
+  oooType *ooo = sim->ooo;
+  decodedType *decodedMem = statePtr->decodedMem;
+  decodedType *dec;          /* Decoded instruction of the entry being handled */
+  robEntryType *e;           /* Reorder buffer entry being handled */
+  robEntryType *older;       /* Older entry a load may depend on */
+  fetchEntryType *fe;        /* Fetch queue entry being dispatched */
+  long long now = statePtr->cycles;
+  int width = sim->config->width;
+  int trace;                 /* Nonzero if this cycle is being traced */
+  int n, i, j, k, reg, forward, target, pc, penalty;
+
+
+    trace = traceCycle(sim->config, statePtr->cycles + 1);
+
+    if (trace)
+        traceState(sim);
+
+    /* Everything older than a HALT at the head has committed */
+    if (ooo->robCount > 0 && decodedMem[ooo->rob[ooo->robHead].instr].op == OP_HALT)
+        return(1);
+
+    /* --------------------- Commit --------------------- */
+
+    for (n = 0; n < width && ooo->robCount > 0; n++) {
+        e = &ooo->rob[ooo->robHead];
+        dec = &decodedMem[e->instr];
+        if (e->status != ROB_DONE || dec->op == OP_HALT)
+            break;
+        switch (dec->op) {
+            case OP_LW:
+                if (checkDataAddr(statePtr, e->addr))
+                    return(1);
+                ooo->lsqCount--;
+                break;
+            case OP_SW:
+                if (checkDataAddr(statePtr, e->addr))
+                    return(1);
+                STOREDATA(&statePtr->dataMem[e->addr / 4], e->value[1]);
+                if (sim->written != NULL)
+                    logWrite(sim, e->addr);
+                if (sim->cache[CACHE_L1D].tags != NULL)
+                    cacheAccess(&sim->cache[CACHE_L1D], e->addr, 1);
+                ooo->lsqCount--;
+                break;
+            case OP_BNE:
+                updatePredictor(&sim->pred, e->pc, e->predHist, e->taken, e->pc + 4 + (dec->immed << 2));
+                sim->stats.numBranches++;
+                if (e->mispredicted)
+                    sim->stats.numMisPred++;
+                break;
+        }
+        if (e->dest >= 0) {
+            reg = (dec->op == OP_LW) ? dec->rt : dec->rd;
+            statePtr->regFile[reg] = ooo->pregValue[e->dest];
+            if (ooo->map[reg] == e->dest)
+                ooo->map[reg] = -1;
+            ooo->freeList[ooo->numFree++] = e->dest;
+        }
+        if (e->instr != NOOPINDEX) {
+            sim->stats.instructions++;
+            if (sim->checker != NULL)
+                logRetire(sim, e->pc, dec->op, dec->op == OP_LW ? dec->rt : dec->rd, e->addr);
+        }
+        sim->stats.opCounts[dec->op]++;
+        if (ooo->redirectId != 0 && e->id > ooo->redirectId)
+            ooo->redirectId = 0;
+        LOGEVENT(sim, EV_RETIRE, 0, e->id, 0);
+        ooo->robHead = (ooo->robHead + 1) % ooo->robSize;
+        ooo->robCount--;
+    }
+
+    /* Charge the commit slots left empty to what holds up the head of the */
+    /* reorder buffer: an empty back end waiting for the instruction       */
+    /* cache, refetching after a mispredicted branch, an empty back end    */
+    /* filling up, a load that missed in the data cache, or else operands  */
+    /* not ready yet.                                                      */
+    sim->stats.cpiSlots[CPI_BASE] += n;
+    if (n < width) {
+        e = &ooo->rob[ooo->robHead];
+        if (ooo->robCount == 0 && statePtr->fetchStall > 0)
+            k = CPI_MEMORY;
+        else if (ooo->redirectId != 0 && (ooo->robCount == 0 || e->id > ooo->redirectId))
+            k = CPI_BRANCH;
+        else if (ooo->robCount == 0)
+            k = CPI_BASE;
+        else if (e->missed)
+            k = CPI_MEMORY;
+        else
+            k = CPI_HAZARD;
+        sim->stats.cpiSlots[k] += width - n;
+    }
+
+    /* --------------------- Complete --------------------- */
+
+    for (i = 0; i < ooo->robCount; i++) {
+        e = &ooo->rob[(ooo->robHead + i) % ooo->robSize];
+        if (e->status != ROB_EXECUTING || e->doneAt > now)
+            continue;
+        e->status = ROB_DONE;
+        LOGEVENT(sim, EV_STAGE, STAGE_COMPLETE, e->id, 0);
+        if (e->dest < 0)
+            continue;
+        ooo->pregValue[e->dest] = e->result;
+        ooo->pregReady[e->dest] = 1;
+        for (j = 0; j < ooo->robCount; j++) {
+            older = &ooo->rob[(ooo->robHead + j) % ooo->robSize];
+            for (k = 0; k < 2; k++)
+                if (older->status == ROB_WAITING && older->src[k] == e->dest) {
+                    older->value[k] = e->result;
+                    older->src[k] = -1;
+                }
+        }
+    }
+
+    /* --------------------- Issue --------------------- */
+
+    for (n = 0, i = 0; n < width && i < ooo->robCount; i++) {
+        e = &ooo->rob[(ooo->robHead + i) % ooo->robSize];
+        dec = &decodedMem[e->instr];
+        if (e->status != ROB_WAITING || e->src[0] >= 0 || e->src[1] >= 0)
+            continue;
+
+        switch (dec->op) {
+            case OP_ADD:
+                e->result = e->value[0] + e->value[1];
+                e->doneAt = now + 1;
+                break;
+            case OP_SUB:
+                e->result = e->value[0] - e->value[1];
+                e->doneAt = now + 1;
+                break;
+            case OP_SW:
+                e->addr = e->value[0] + dec->immed;
+                e->doneAt = now + 1;
+                break;
+            case OP_LW:
+                e->addr = e->value[0] + dec->immed;
+                for (forward = -1, j = 0; j < i; j++) {
+                    older = &ooo->rob[(ooo->robHead + j) % ooo->robSize];
+                    if (decodedMem[older->instr].op != OP_SW)
+                        continue;
+                    if (older->status == ROB_WAITING)
+                        break;
+                    if (older->addr / 4 == e->addr / 4)
+                        forward = j;
+                }
+                if (j < i)
+                    continue; /* an older store's address is not known yet */
+                if (forward >= 0) {
+                    older = &ooo->rob[(ooo->robHead + forward) % ooo->robSize];
+                    LOGEVENT(sim, EV_FORWARD, FWD_STORE, e->id, older->id);
+                    sim->stats.forwards[FWD_STORE]++;
+                    e->result = older->value[1];
+                    e->doneAt = now + 1;
+                } else if (e->addr < 0 || e->addr / 4 >= statePtr->numDataMem) {
+                    e->result = 0; /* faults if it commits */
+                    e->doneAt = now + 1;
+                } else {
+                    e->result = LOADDATA(&statePtr->dataMem[e->addr / 4]);
+                    penalty = 0;
+                    if (sim->cache[CACHE_L1D].tags != NULL)
+                        penalty = cacheAccess(&sim->cache[CACHE_L1D], e->addr, 0);
+                    e->doneAt = now + 1 + penalty;
+                    e->missed = penalty > 0;
+                }
+                break;
+            case OP_BNE:
+                e->taken = (e->value[0] != e->value[1]);
+                e->mispredicted = (e->taken != e->predTaken);
+                e->doneAt = now + 1;
+                break;
+        }
+        e->status = ROB_EXECUTING;
+        ooo->iqCount--;
+        n++;
+        LOGEVENT(sim, EV_STAGE, STAGE_ISSUE, e->id, 0);
+        if (dec->op == OP_BNE)
+            LOGEVENT(sim, EV_BRANCH, e->taken | e->mispredicted << 1, e->id, 0);
+
+        if (dec->op == OP_BNE && e->mispredicted) {
+            if (trace)
+                traceText(sim, "\nBranch Mispredicted\n");
+            squashYounger(sim, i + 1);
+            ooo->redirectId = e->id;
+            statePtr->PC = e->taken ? e->pc + 4 + (dec->immed << 2) : e->pc + 4;
+            statePtr->fetchStall = 0;
+            statePtr->fetchDone = 0;
+            break;
+        }
+    }
+
+    /* --------------------- Dispatch --------------------- */
+
+    for (n = 0; n < width && ooo->fqCount > 0; n++) {
+        fe = &ooo->fetchQueue[ooo->fqHead];
+        dec = &decodedMem[fe->instr];
+        reg = (dec->op == OP_ADD || dec->op == OP_SUB || dec->op == OP_LW);
+        if (ooo->robCount == ooo->robSize) {
+            sim->stats.numRobFull++;
+            LOGEVENT(sim, EV_STALL, STALL_ROB, fe->id, 0);
+            break;
+        }
+        if (dec->op != OP_NOOP && dec->op != OP_HALT && ooo->iqCount == ooo->iqSize) {
+            sim->stats.numIqFull++;
+            LOGEVENT(sim, EV_STALL, STALL_IQ, fe->id, 0);
+            break;
+        }
+        if ((dec->op == OP_LW || dec->op == OP_SW) && ooo->lsqCount == ooo->lsqSize) {
+            sim->stats.numLsqFull++;
+            LOGEVENT(sim, EV_STALL, STALL_LSQ, fe->id, 0);
+            break;
+        }
+        if (reg && ooo->numFree == 0) {
+            sim->stats.numRegsFull++;
+            LOGEVENT(sim, EV_STALL, STALL_REGS, fe->id, 0);
+            break;
+        }
+
+        e = &ooo->rob[(ooo->robHead + ooo->robCount) % ooo->robSize];
+        memset(e, 0, sizeof(*e));
+        e->instr = fe->instr;
+        e->pc = fe->pc;
+        e->predTaken = fe->predTaken;
+        e->predHist = fe->predHist;
+        e->id = fe->id;
+        e->src[0] = e->src[1] = -1;
+        e->dest = -1;
+
+        /* Read the operands: rs for everything but NOOP and HALT, rt for R-type, SW and BNE */
+        for (k = 0; k < 2; k++) {
+            int arch = k == 0 ? dec->rs : dec->rt;
+            int p = ooo->map[arch];
+            if (dec->op == OP_NOOP || dec->op == OP_HALT || (k == 1 && dec->op == OP_LW))
+                continue;
+            if (p < 0)
+                e->value[k] = statePtr->regFile[arch];
+            else if (ooo->pregReady[p])
+                e->value[k] = ooo->pregValue[p];
+            else
+                e->src[k] = p;
+        }
+        if (reg) {
+            e->dest = ooo->freeList[--ooo->numFree];
+            ooo->pregReady[e->dest] = 0;
+            ooo->map[dec->op == OP_LW ? dec->rt : dec->rd] = e->dest;
+        }
+        if (dec->op == OP_NOOP || dec->op == OP_HALT) {
+            e->status = ROB_DONE;
+        } else {
+            e->status = ROB_WAITING;
+            ooo->iqCount++;
+        }
+        if (dec->op == OP_LW || dec->op == OP_SW)
+            ooo->lsqCount++;
+        ooo->robCount++;
+        LOGEVENT(sim, EV_STAGE, STAGE_DISPATCH, e->id, 0);
+        ooo->fqHead = (ooo->fqHead + 1) % (2 * MAXWIDTH);
+        ooo->fqCount--;
+    }
+
+    /* --------------------- Fetch --------------------- */
+
+    if (fetch && sim->cache[CACHE_L1I].tags != NULL && !statePtr->fetchDone
+        && statePtr->PC >= 0 && statePtr->PC / 4 < statePtr->numInstrMem) {
+        statePtr->fetchStall = cacheAccess(&sim->cache[CACHE_L1I], statePtr->PC | INSTRSPACE, 0);
+        statePtr->fetchDone = 1;
+    }
+
+    if (fetch && statePtr->fetchStall > 0) {
+        if (trace)
+            traceText(sim, "\nFetch Stall\n");
+        LOGEVENT(sim, EV_STALL, STALL_FETCH, 0, statePtr->PC);
+        statePtr->fetchStall--;
+        sim->stats.numFetchStalls++;
+    } else if (fetch) {
+        for (n = 0; n < width && ooo->fqCount < 2 * width; n++) {
+            pc = statePtr->PC;
+            fe = &ooo->fetchQueue[(ooo->fqHead + ooo->fqCount) % (2 * MAXWIDTH)];
+            fe->pc = pc;
+            fe->instr = (pc >= 0 && pc / 4 < statePtr->numInstrMem) ? DECODEDINDEX(pc) : ENDINDEX(statePtr);
+            fe->predTaken = predictBranch(&sim->pred, pc, &fe->predHist, &target);
+            fe->id = statePtr->nextId++;
+            if (sim->timeline != NULL)
+                logFetch(sim->timeline, statePtr, fe->id, pc, fe->instr);
+            ooo->fqCount++;
+            statePtr->PC = fe->predTaken ? target : pc + 4;
+            statePtr->fetchDone = 0;
+            if (fe->predTaken)
+                break;
+        }
+    }
+
+    sim->stats.robBusy += ooo->robCount;
+    sim->stats.iqBusy += ooo->iqCount;
+    sim->stats.lsqBusy += ooo->lsqCount;
+    statePtr->cycles++;
+
+    return(0);
+
+}
+
+/*************************************************************/
+/* The startTrace function starts the trace writer thread.   */
+/* The simulation thread only copies what is to be printed   */
+/* into fixed-size records in a single-producer, single-     */
+/* consumer ring buffer, and the writer formats them         */
+/* with printState into a large standard output buffer (set */
+/* up by main), so the two overlap. Returns NULL if the      */
+/* thread cannot be created.                                 */
+/*************************************************************/
+traceRingType *startTrace(stateType *statePtr)
+{
+    traceRingType *ring;
+
+    if ((ring = malloc(sizeof(traceRingType))) == NULL)
+        return(NULL);
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->decodedMem = statePtr->decodedMem;
+    if (pthread_create(&ring->thread, NULL, traceWriter, ring) != 0) {
+        free(ring);
+        return(NULL);
+    }
+    return(ring);
+}
+
+/*************************************************************/
+/* The stopTrace function waits for the writer to print      */
+/* every record and flushes standard output.                 */
+/*************************************************************/
+void stopTrace(traceRingType *ring)
+{
+    traceSlot(ring)->kind = TR_END;
+    tracePush(ring);
+    pthread_join(ring->thread, NULL);
+    fflush(stdout);
+    free(ring);
+}
+
+/*************************************************************/
+/* The traceSlot function returns the next free record in    */
+/* the ring. If the ring is full it waits until the writer   */
+/* has emptied half of it, rather than handing the processor */
+/* back and forth for every record. The record is not seen   */
+/* by the writer until tracePush.                            */
+/*************************************************************/
+traceRecordType *traceSlot(traceRingType *ring)
+{
+    unsigned long tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    int idle = 0;
+
+    if (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == TRACESLOTS)
+        while (tail - atomic_load_explicit(&ring->head, memory_order_acquire) > TRACESLOTS / 2)
+            traceWait(&idle);
+    return(&ring->slots[tail % TRACESLOTS]);
+}
+
+void tracePush(traceRingType *ring)
+{
+    atomic_store_explicit(&ring->tail, atomic_load_explicit(&ring->tail, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+/*************************************************************/
+/* The traceState function queues the state at the beginning */
+/* of the cycle, and for the out-of-order model the contents */
+/* of the reorder buffer, oldest first.                      */
+/*************************************************************/
+void traceState(simType *sim)
+{
+    traceRingType *ring = sim->tracer;
+    stateType *statePtr = &sim->state;
+    oooType *ooo = sim->ooo;
+    traceRecordType *r;
+    robEntryType *e;
+    int i;
+
+    r = traceSlot(ring);
+    r->kind = TR_STATE;
+    r->u.state.cycles = statePtr->cycles;
+    r->u.state.PC = statePtr->PC;
+    r->u.state.width = statePtr->width;
+    memcpy(r->u.state.dataMem, statePtr->dataMem, sizeof(r->u.state.dataMem));
+    memcpy(r->u.state.regFile, statePtr->regFile, sizeof(r->u.state.regFile));
+    r->u.state.pipe = statePtr->pipe[statePtr->cur];
+    tracePush(ring);
+    if (ooo == NULL)
+        return;
+    r = traceSlot(ring);
+    r->kind = TR_ROB;
+    r->u.rob.count = ooo->robCount;
+    r->u.rob.size = ooo->robSize;
+    tracePush(ring);
+    for (i = 0; i < ooo->robCount; i++) {
+        e = &ooo->rob[(ooo->robHead + i) % ooo->robSize];
+        r = traceSlot(ring);
+        r->kind = TR_ROBENTRY;
+        r->u.entry.pc = e->pc;
+        r->u.entry.status = e->status;
+        r->u.entry.instr = e->instr;
+        tracePush(ring);
+    }
+}
+
+/* Queue a message; text must be a string constant, since it is printed later */
+void traceText(simType *sim, const char *text)
+{
+    traceRecordType *r = traceSlot(sim->tracer);
+
+    r->kind = TR_TEXT;
+    r->u.text = text;
+    tracePush(sim->tracer);
+}
+
+/*************************************************************/
+/* The traceWriter function is the trace writer thread. It   */
+/* prints the records in the order they were queued until    */
+/* it finds a TR_END record. A TR_STATE record is printed by */
+/* printState, from a stateType that has the record's values */
+/* and the simulation's decoded instructions.                */
+/*************************************************************/
+void *traceWriter(void *arg)
+{
+    static const char *status[] = {"waiting", "executing", "done"};
+    traceRingType *ring = arg;
+    traceRecordType *r;
+    stateType view;
+    unsigned long head = 0;
+    int idle = 0;
+
+    memset(&view, 0, sizeof(view));
+    view.decodedMem = ring->decodedMem;
+    while (1) {
+        if (head == atomic_load_explicit(&ring->tail, memory_order_acquire)) {
+            traceWait(&idle);
+            continue;
+        }
+        idle = 0;
+        r = &ring->slots[head % TRACESLOTS];
+        switch (r->kind) {
+            case TR_STATE:
+                view.cycles = r->u.state.cycles;
+                view.PC = r->u.state.PC;
+                view.width = r->u.state.width;
+                view.dataMem = r->u.state.dataMem;
+                memcpy(view.regFile, r->u.state.regFile, sizeof(view.regFile));
+                view.pipe[0] = r->u.state.pipe;
+                printState(&view);
+                break;
+            case TR_TEXT:
+                fputs(r->u.text, stdout);
+                break;
+            case TR_ROB:
+                printf("\tReorder buffer (%d of %d entries):\n", r->u.rob.count, r->u.rob.size);
+                break;
+            case TR_ROBENTRY:
+                printf("\t\t%d: %-9s ", r->u.entry.pc, status[r->u.entry.status]);
+                printInstruction(ring->decodedMem[r->u.entry.instr].instr);
+                break;
+            case TR_END:
+                return(NULL);
+        }
+        atomic_store_explicit(&ring->head, ++head, memory_order_release);
+    }
+}
+
+/* Back off while the ring is empty or full: yield at first, then sleep */
+void traceWait(int *idle)
+{
+    struct timespec nap = {0, 50000};
+
+    if ((*idle)++ < TRACESPINS)
+        sched_yield();
+    else
+        nanosleep(&nap, NULL);
+}
+
+/*************************************************************/
+/* The startHistory function opens the debugger commands in  */
+/* file and starts an empty history; recordHistory fills it  */
+/* in. Returns NULL if the file cannot be opened.            */
+/*************************************************************/
+historyType *startHistory(char *file)
+{
+    historyType *h;
+
+    if ((h = calloc(1, sizeof(historyType))) == NULL)
+        return(NULL);
+    if ((h->commands = fopen(file, "r")) == NULL) {
+        free(h);
+        return(NULL);
+    }
+    return(h);
+}
+
+/* Close the commands and free the history */
+void freeHistory(historyType *h)
+{
+    long long i;
+    int r;
+
+    fclose(h->commands);
+    for (r = 0; r < NUMREGS; r++)
+        free(h->regWrites[r].cycles);
+    for (i = 0; i < h->capMemWrites; i++)
+        free(h->memWrites[i].cycles);
+    free(h->memWrites);
+    if (h->view.dataMem != NULL)
+        freeMemory(h->view.dataMem, 4 * (size_t)h->view.numDataMem);
+    free(h->snaps);
+    free(h->steps);
+    free(h->flips);
+    free(h->stores);
+    free(h);
+}
+
+/* Stop recording when the history cannot grow, and let the run go on without it */
+void dropHistory(simType *sim)
+{
+    fprintf(stderr, "error: out of memory for the -debug history; the run continues without it\n");
+    freeHistory(sim->history);
+    sim->history = NULL;
+}
+
+/* Return list, of *cap elements of size bytes, reallocated to twice as many (first */
+/* if there are none), and update *cap; NULL, leaving both alone, on failure */
+void *growList(void *list, long long *cap, long long first, size_t size)
+{
+    long long n = *cap ? 2 * *cap : first;
+
+    if ((list = realloc(list, size * (size_t)n)) != NULL)
+        *cap = n;
+    return(list);
+}
+
+/*************************************************************/
+/* The recordHistory function records the cycle run since    */
+/* the previous call, if any: the words of the state that it */
+/* changed, as the bits that flipped, so that the same flips */
+/* take the state forward or back a cycle. The stores were   */
+/* recorded as they were made (see logStore). Only the       */
+/* current pipeline registers are recorded, moved to pipe[0] */
+/* so that the double buffering does not show up as changes. */
+/* Every HISTSNAP cycles the whole state, but not the data   */
+/* memory, is kept as a snapshot. The first call records the */
+/* starting state. If the history cannot grow, it is dropped */
+/* (see dropHistory).                                        */
+/*************************************************************/
+void recordHistory(simType *sim)
+{
+    historyType *h = sim->history;
+    stateType now = sim->state;
+    unsigned int *was = (unsigned int *)&h->shadow;
+    unsigned int *is = (unsigned int *)&now;
+    size_t regs = offsetof(stateType, regFile) / sizeof(int);
+    size_t i;
+    void *grown;
+
+    now.pipe[0] = sim->state.pipe[sim->state.cur];
+    memset(&now.pipe[1], 0, sizeof(pipeType));
+    now.cur = 0;
+
+    if (h->steps == NULL) {
+        h->shadow = now;
+        h->capSteps = h->capSnaps = 64;
+        if ((h->steps = calloc(h->capSteps, sizeof(stepType))) == NULL
+            || (h->snaps = malloc(sizeof(stateType) * h->capSnaps)) == NULL) {
+            dropHistory(sim);
+            return;
+        }
+        h->snaps[h->numSnaps++] = now;
+        return;
+    }
+
+    for (i = 0; i < HISTWORDS; i++) {
+        if (is[i] == was[i])
+            continue;
+        if (h->numFlips == h->capFlips) {
+            if ((grown = growList(h->flips, &h->capFlips, 1024, sizeof(flipType))) == NULL) {
+                dropHistory(sim);
+                return;
+            }
+            h->flips = grown;
+        }
+        h->flips[h->numFlips].word = (int)i;
+        h->flips[h->numFlips].bits = is[i] ^ was[i];
+        h->numFlips++;
+        if (i - regs < NUMREGS && noteChange(&h->regWrites[i - regs], h->numSteps) != 0) {
+            dropHistory(sim);
+            return;
+        }
+        was[i] = is[i];
+    }
+
+    if (h->numSteps + 2 > h->capSteps) {
+        if ((grown = growList(h->steps, &h->capSteps, 64, sizeof(stepType))) == NULL) {
+            dropHistory(sim);
+            return;
+        }
+        h->steps = grown;
+    }
+    h->numSteps++;
+    h->steps[h->numSteps].flips = h->numFlips;
+    h->steps[h->numSteps].stores = h->numStores;
+    if (h->numSteps % HISTSNAP == 0) {
+        if (h->numSnaps == h->capSnaps) {
+            if ((grown = growList(h->snaps, &h->capSnaps, 64, sizeof(stateType))) == NULL) {
+                dropHistory(sim);
+                return;
+            }
+            h->snaps = grown;
+        }
+        h->snaps[h->numSnaps++] = h->shadow;
+    }
+}
+
+/* Record a store of value to the data memory word at addr in the current cycle, */
+/* if it changes the word; called before the store is made */
+void logStore(simType *sim, int addr, int value)
+{
+    historyType *h = sim->history;
+    writesType *w;
+    int word = addr / 4;
+    void *grown;
+
+    if (sim->state.dataMem[word] == value)
+        return;
+    if (h->numStores == h->capStores) {
+        if ((grown = growList(h->stores, &h->capStores, 1024, sizeof(storeType))) == NULL) {
+            dropHistory(sim);
+            return;
+        }
+        h->stores = grown;
+    }
+    h->stores[h->numStores].word = word;
+    h->stores[h->numStores].old = sim->state.dataMem[word];
+    h->stores[h->numStores].value = value;
+    h->numStores++;
+    if ((w = findWrites(h, word, 1)) == NULL || noteChange(w, h->numSteps) != 0)
+        dropHistory(sim);
+}
+
+/*************************************************************/
+/* The findWrites function returns the cycles that changed   */
+/* data memory word, from the hash table that holds only the */
+/* words stored to, so that it takes memory in proportion to */
+/* the stores rather than to the data memory. If the word    */
+/* has none, it returns NULL, or if add is nonzero an empty  */
+/* list for it, growing the table to keep it at most half    */
+/* full; NULL if the table cannot grow.                      */
+/*************************************************************/
+writesType *findWrites(historyType *h, int word, int add)
+{
+    writesType *table;
+    long long cap, i, j;
+
+    /* Empty slots end the runs of slots a word can be in */
+    if (h->capMemWrites > 0)
+        for (j = HISTHASH(word, h->capMemWrites); h->memWrites[j].cycles != NULL; j = (j + 1) & (h->capMemWrites - 1))
+            if (h->memWrites[j].word == word)
+                return(&h->memWrites[j]);
+    if (!add)
+        return(NULL);
+
+    if (2 * (h->numMemWrites + 1) > h->capMemWrites) {
+        cap = h->capMemWrites ? 2 * h->capMemWrites : 64;
+        if ((table = calloc(cap, sizeof(writesType))) == NULL)
+            return(NULL);
+        for (i = 0; i < h->capMemWrites; i++) {
+            if (h->memWrites[i].cycles == NULL)
+                continue;
+            for (j = HISTHASH(h->memWrites[i].word, cap); table[j].cycles != NULL; j = (j + 1) & (cap - 1))
+                ;
+            table[j] = h->memWrites[i];
+        }
+        free(h->memWrites);
+        h->memWrites = table;
+        h->capMemWrites = cap;
+    }
+    for (j = HISTHASH(word, h->capMemWrites); h->memWrites[j].cycles != NULL; j = (j + 1) & (h->capMemWrites - 1))
+        ;
+    /* A list has room for its first cycle as soon as it is made, see logStore */
+    if ((h->memWrites[j].cycles = growList(NULL, &h->memWrites[j].cap, 16, sizeof(long long))) == NULL)
+        return(NULL);
+    h->memWrites[j].word = word;
+    h->numMemWrites++;
+    return(&h->memWrites[j]);
+}
+
+/* Add a recorded cycle to the cycles that changed a word, once. */
+/* Returns nonzero if the list cannot grow. */
+int noteChange(writesType *w, long long step)
+{
+    void *grown;
+
+    if (w->num > 0 && w->cycles[w->num - 1] == step)
+        return(0);
+    if (w->num == w->cap) {
+        if ((grown = growList(w->cycles, &w->cap, 16, sizeof(long long))) == NULL)
+            return(1);
+        w->cycles = grown;
+    }
+    w->cycles[w->num++] = step;
+    return(0);
+}
+
+/* Return the last recorded cycle before at that changed a word, -1 if none */
+long long lastChange(writesType *w, long long at)
+{
+    long long lo = 0, hi = w->num, mid;
+
+    /* The first of them at or after at */
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (w->cycles[mid] < at)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return(lo > 0 ? w->cycles[lo - 1] : -1);
+}
+
+/*************************************************************/
+/* The seekHistory function moves the view to the state      */
+/* after at recorded cycles. The data memory is moved by the */
+/* stores in between, redone or undone. The rest of the      */
+/* state starts from the view or from the last snapshot at   */
+/* or before at, whichever is fewer cycles away, and takes   */
+/* the flips of the cycles in between, so no move takes more */
+/* than HISTSNAP cycles' flips.                              */
+/*************************************************************/
+void seekHistory(historyType *h, long long at)
+{
+    stateType *v = &h->view;
+    int *dataMem = v->dataMem;
+    long long snap = at / HISTSNAP * HISTSNAP;
+    long long from, to, i;
+    unsigned int *words;
+
+    if (at > h->at)
+        for (i = h->steps[h->at].stores; i < h->steps[at].stores; i++)
+            dataMem[h->stores[i].word] = h->stores[i].value;
+    else
+        for (i = h->steps[h->at].stores - 1; i >= h->steps[at].stores; i--)
+            dataMem[h->stores[i].word] = h->stores[i].old;
+
+    if (at - snap < (at > h->at ? at - h->at : h->at - at)) {
+        *v = h->snaps[at / HISTSNAP];
+        v->dataMem = dataMem;
+        from = snap;
+        to = at;
+    } else {
+        from = at < h->at ? at : h->at;
+        to = at < h->at ? h->at : at;
+    }
+    words = (unsigned int *)v;
+    for (i = h->steps[from].flips; i < h->steps[to].flips; i++)
+        words[h->flips[i].word] ^= h->flips[i].bits;
+    v->dataMem = dataMem;
+    h->at = at;
+}
+
+/* Return a word of the state after at recorded cycles, from the snapshot before it */
+int historyWord(historyType *h, int word, long long at)
+{
+    unsigned int value = ((unsigned int *)&h->snaps[at / HISTSNAP])[word];
+    long long i;
+
+    for (i = h->steps[at / HISTSNAP * HISTSNAP].flips; i < h->steps[at].flips; i++)
+        if (h->flips[i].word == word)
+            value ^= h->flips[i].bits;
+    return((int)value);
+}
+
+/*************************************************************/
+/* The runDebugger function answers the debugger commands    */
+/* once the run is over, one per line:                       */
+/*   goto N    show the state at the beginning of cycle N    */
+/*   step [K]  move K cycles forward (default 1) and show it */
+/*   back [K]  move K cycles back                            */
+/*   reg R     the last change to regFile[R] before the      */
+/*             cycle shown, with its old and new values      */
+/*   mem A     the same for dataMem[A]                       */
+/*   print     show the state again                          */
+/*   quit                                                    */
+/* Every command takes a number of flips bounded by HISTSNAP */
+/* cycles and the stores in between, however long the run.   */
+/* The view starts at the end of the run.                    */
+/*************************************************************/
+void runDebugger(simType *sim)
+{
+    historyType *h = sim->history;
+    char line[256];
+    char cmd[32];
+    writesType *w;
+    long long first, arg, at, step, i;
+    int prompt = isatty(fileno(h->commands));
+    int args, old = 0, value = 0;
+
+    if (h->steps == NULL) {
+        printf("debug: no cycles were recorded\n");
+        return;
+    }
+    first = h->snaps[0].cycles + 1;
+    h->view = h->shadow;
+    if ((h->view.dataMem = allocMemory(4 * (size_t)h->shadow.numDataMem)) == NULL) {
+        fprintf(stderr, "error: no memory to show the recorded cycles\n");
+        return;
+    }
+    memcpy(h->view.dataMem, sim->state.dataMem, 4 * (size_t)h->shadow.numDataMem);
+    h->at = h->numSteps;
+    printf("debug: recorded cycles %lld to %lld\n", first, first + h->numSteps - 1);
+
+    for (;;) {
+        if (prompt) {
+            printf("(debug) ");
+            fflush(stdout);
+        }
+        if (fgets(line, sizeof(line), h->commands) == NULL)
+            break;
+        if ((args = sscanf(line, "%31s %lld", cmd, &arg)) < 1)
+            continue;
+        at = h->at;
+        if (strcmp(cmd, "goto") == 0 && args == 2) {
+            at = arg - first;
+        } else if (strcmp(cmd, "step") == 0) {
+            at += (args == 2) ? arg : 1;
+        } else if (strcmp(cmd, "back") == 0) {
+            at -= (args == 2) ? arg : 1;
+        } else if (strcmp(cmd, "reg") == 0 && args == 2 && arg >= 0 && arg < NUMREGS) {
+            if ((step = lastChange(&h->regWrites[arg], h->at)) < 0) {
+                printf("regFile[%lld] = %d, unchanged since cycle %lld\n", arg, h->view.regFile[arg], first);
+            } else {
+                i = offsetof(stateType, regFile) / sizeof(int) + arg;
+                printf("regFile[%lld] changed from %d to %d in cycle %lld\n", arg,
+                    historyWord(h, (int)i, step), historyWord(h, (int)i, step + 1), first + step);
+            }
+            continue;
+        } else if (strcmp(cmd, "mem") == 0 && args == 2 && arg >= 0 && arg < h->view.numDataMem) {
+            if ((w = findWrites(h, (int)arg, 0)) == NULL || (step = lastChange(w, h->at)) < 0) {
+                printf("dataMem[%lld] = %d, unchanged since cycle %lld\n", arg, h->view.dataMem[arg], first);
+            } else {
+                /* Its first store in that cycle found the old value, the last left the new one */
+                for (i = h->steps[step + 1].stores - 1; i >= h->steps[step].stores; i--)
+                    if (h->stores[i].word == arg)
+                        old = h->stores[i].old;
+                for (i = h->steps[step].stores; i < h->steps[step + 1].stores; i++)
+                    if (h->stores[i].word == arg)
+                        value = h->stores[i].value;
+                printf("dataMem[%lld] changed from %d to %d in cycle %lld\n", arg, old, value, first + step);
+            }
+            continue;
+        } else if (strcmp(cmd, "quit") == 0) {
+            break;
+        } else if (strcmp(cmd, "print") != 0) {
+            printf("debug: the commands are goto N, step [K], back [K], reg R (0 to %d), mem A (0 to %d), print and quit\n",
+                NUMREGS - 1, h->view.numDataMem - 1);
+            continue;
+        }
+        if (at < 0)
+            at = 0;
+        if (at > h->numSteps)
+            at = h->numSteps;
+        seekHistory(h, at);
+        printState(&h->view);
+    }
+    fflush(stdout);
+}
+
+/*************************************************************/
+/* The openTimeline function creates a timeline trace: a     */
+/* timelineHeaderType followed by eventType records, each    */
+/* giving its cycle as a delta from the previous one. The    */
+/* events are buffered and written TIMELINEBUFFER at a time, */
+/* so tracing long runs costs little more than the stores    */
+/* into the buffer. Returns NULL if the file cannot be       */
+/* created.                                                  */
+/*************************************************************/
+timelineType *openTimeline(char *file, stateType *statePtr)
+{
+    timelineHeaderType header;
+    timelineType *tl;
+
+    if ((tl = calloc(1, sizeof(timelineType))) == NULL)
+        return(NULL);
+    tl->described = calloc((size_t)statePtr->numInstrMem + 2, 1);
+    if (tl->described == NULL || (tl->file = fopen(file, "wb")) == NULL) {
+        free(tl->described);
+        free(tl);
+        return(NULL);
+    }
+    tl->name = file;
+    tl->lastCycle = statePtr->cycles;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TIMELINEMAGIC, sizeof(header.magic));
+    header.version = TIMELINEVERSION;
+    header.eventSize = sizeof(eventType);
+    header.firstId = statePtr->nextId;
+    header.startCycle = statePtr->cycles;
+    if (fwrite(&header, sizeof(header), 1, tl->file) != 1)
+        tl->error = 1;
+    return(tl);
+}
+
+/*************************************************************/
+/* The closeTimeline function writes the buffered events,    */
+/* closes the trace and frees it. Returns nonzero if any     */
+/* write failed.                                             */
+/*************************************************************/
+int closeTimeline(timelineType *tl)
+{
+    int error;
+
+    if (tl->numEvents > 0 && fwrite(tl->events, sizeof(eventType), tl->numEvents, tl->file) != (size_t)tl->numEvents)
+        tl->error = 1;
+    if (fclose(tl->file) != 0)
+        tl->error = 1;
+    error = tl->error;
+    free(tl->described);
+    free(tl);
+    return(error);
+}
+
+/*************************************************************/
+/* The logEvent function appends an event in the given       */
+/* cycle, which must not be earlier than the last event's.   */
+/* Gaps too long for the 16-bit delta are covered by EV_SKIP */
+/* events, and value goes in an EV_VALUE record for the      */
+/* kinds that have one.                                      */
+/*************************************************************/
+void logEvent(timelineType *tl, long long cycle, int kind, int arg, unsigned int id, unsigned int value)
+{
+    long long skip;
+
+    while (cycle - tl->lastCycle > 0xffff) {
+        skip = cycle - tl->lastCycle > 0xffffffffLL ? 0xffffffffLL : cycle - tl->lastCycle;
+        putEvent(tl, 0, EV_SKIP, 0, (unsigned int)skip);
+        tl->lastCycle += skip;
+    }
+    putEvent(tl, (int)(cycle - tl->lastCycle), kind, arg, id);
+    tl->lastCycle = cycle;
+    if (kind == EV_INSTR || kind == EV_FETCH || kind == EV_FORWARD)
+        putEvent(tl, 0, EV_VALUE, 0, value);
+}
+
+/*************************************************************/
+/* The putEvent function adds one record to the buffer,      */
+/* writing the buffer out first if it is full.               */
+/*************************************************************/
+void putEvent(timelineType *tl, int delta, int kind, int arg, unsigned int id)
+{
+    eventType *ev;
+
+    if (tl->numEvents == TIMELINEBUFFER) {
+        if (fwrite(tl->events, sizeof(eventType), TIMELINEBUFFER, tl->file) != TIMELINEBUFFER)
+            tl->error = 1;
+        tl->numEvents = 0;
+    }
+    ev = &tl->events[tl->numEvents++];
+    ev->id = id;
+    ev->delta = delta;
+    ev->kind = kind;
+    ev->arg = arg;
+}
+
+/*************************************************************/
+/* The logFetch function records that instruction id was     */
+/* fetched from pc (decodedMem index instr) in the current   */
+/* cycle, preceded by its encoding the first time the        */
+/* address is fetched.                                       */
+/*************************************************************/
+void logFetch(timelineType *tl, stateType *statePtr, unsigned int id, int pc, int instr)
+{
+    if (instr != NOOPINDEX && !tl->described[instr]) {
+        tl->described[instr] = 1;
+        logEvent(tl, statePtr->cycles, EV_INSTR, 0, pc, statePtr->decodedMem[instr].instr);
+    }
+    logEvent(tl, statePtr->cycles, EV_FETCH, 0, id, pc);
+}
 
-                    newState.EXMEM.aluResult = ((state.IDEX.readData1) + (state.IDEX.immed));
+/*************************************************************/
+/* The logPipeline function records the end of an in-order   */
+/* cycle by comparing the instruction numbers in the         */
+/* pipeline registers before (pipe) and after (newPipe) it:  */
+/* an instruction that appears in a register it was not in   */
+/* before enters the next stage in the next cycle (and       */
+/* retires once it reaches MEM/WB, where it writes back),    */
+/* one new in IF/ID was fetched in this cycle, and one that  */
+/* left IF/ID or ID/EX without moving on was squashed. A     */
+/* fetch thrown away in the same cycle (by a stall in ID or  */
+/* a mispredicted branch) is not recorded.                   */
+/*************************************************************/
+void logPipeline(simType *sim, pipeType *pipe, pipeType *newPipe)
+{
+    stateType *statePtr = &sim->state;
+    timelineType *tl = sim->timeline;
+    unsigned int before[4][MAXWIDTH];  /* Instruction numbers in IF/ID, ID/EX, EX/MEM and MEM/WB */
+    unsigned int after[4][MAXWIDTH];
+    long long next = statePtr->cycles + 1;
+    int width = statePtr->width;
+    int stage, i, j, k;
+
+    for (i = 0; i < width; i++) {
+        before[0][i] = pipe->IFID[i].id;
+        before[1][i] = pipe->IDEX[i].id;
+        before[2][i] = pipe->EXMEM[i].id;
+        before[3][i] = pipe->MEMWB[i].id;
+        after[0][i] = newPipe->IFID[i].id;
+        after[1][i] = newPipe->IDEX[i].id;
+        after[2][i] = newPipe->EXMEM[i].id;
+        after[3][i] = newPipe->MEMWB[i].id;
+    }
 
-                    break;
+    /* Fetched this cycle */
+    for (i = 0; i < width; i++) {
+        for (j = 0; j < width && before[0][j] != after[0][i]; j++)
+            ;
+        if (after[0][i] != 0 && j == width)
+            logFetch(tl, statePtr, after[0][i], newPipe->IFID[i].PCPlus4 - 4, newPipe->IFID[i].instr);
+    }
 
-                case BNE:
+    /* Squashed */
+    for (stage = 0; stage < 2; stage++)
+        for (i = 0; i < width; i++) {
+            if (before[stage][i] == 0)
+                continue;
+            for (k = 0, j = 0; j < width; j++)
+                if (after[stage][j] == before[stage][i] || after[stage + 1][j] == before[stage][i])
+                    k = 1;
+            if (!k)
+                logEvent(tl, next, EV_FLUSH, 0, before[stage][i], 0);
+        }
 
-                    newState.EXMEM.writeReg = get_rt(newState.EXMEM.instr);
+    /* Moving on to ID, EX, MEM or WB */
+    for (stage = 0; stage < 4; stage++)
+        for (i = 0; i < width; i++) {
+            for (j = 0; j < width && before[stage][j] != after[stage][i]; j++)
+                ;
+            if (after[stage][i] == 0 || j < width)
+                continue;
+            logEvent(tl, next, EV_STAGE, STAGE_ID + stage, after[stage][i], 0);
+            if (stage == 3)
+                logEvent(tl, next, EV_RETIRE, 0, after[stage][i], 0);
+        }
+}
 
-                    newState.EXMEM.writeDataReg = state.regFile[get_rt(newState.EXMEM.instr)];
+/*************************************************************/
+/* The printKonata function prints the timeline trace in     */
+/* file as a Kanata log, the text format read by the Konata  */
+/* pipeline viewer: one lane per instruction with its        */
+/* stages, stalls, forwarding (also drawn as dependences)    */
+/* and branch outcomes as notes, retired at the end of its   */
+/* last stage or flushed when squashed. Returns nonzero if   */
+/* the file is not a timeline.                               */
+/*************************************************************/
+int printKonata(char *file)
+{
+    static const char *stages[] = {"F", "D", "X", "M", "W", "Ds", "Is", "Cm"};
+    static const char *stalls[] = {"load-use stall", "issue group split (dependence)",
+        "issue group split (memory port)", "fetch stall", "memory stall", "reorder buffer full",
+        "issue queue full", "load/store queue full", "no free rename register"};
+    static const char *paths[] = {"(1a) ForwardA = 10", "(2a) ForwardA = 01", "(1b) ForwardB = 10",
+        "(2b) ForwardB = 01", "store-to-load forwarding"};
+    timelineHeaderType header;
+    eventType ev, extra;             /* Event, and the EV_VALUE record that may follow it */
+    unsigned int value;
+    FILE *in;
+    unsigned int *words = NULL;      /* Encodings of the instructions seen, by address / 4 */
+    size_t numWords = 0;
+    unsigned int *pending = NULL;    /* Instructions retiring at the end of the current cycle */
+    size_t numPending = 0, maxPending = 0;
+    unsigned int base;               /* Number of the first instruction fetched, Kanata's 0 */
+    long long cycle, shown;          /* Cycle of the current event, and of the log */
+    long long retired = 0;
+    size_t j;
+
+    if ((in = fopen(file, "rb")) == NULL) {
+        fprintf(stderr, "error: cannot open timeline %s\n", file);
+        return(1);
+    }
+    if (fread(&header, sizeof(header), 1, in) != 1
+        || memcmp(header.magic, TIMELINEMAGIC, sizeof(header.magic)) != 0
+        || header.version != TIMELINEVERSION || header.eventSize != sizeof(eventType)) {
+        fprintf(stderr, "error: %s is not a version %d timeline from this simulator\n", file, TIMELINEVERSION);
+        fclose(in);
+        return(1);
+    }
 
-                    newState.EXMEM.aluResult = (state.regFile[get_rs(newState.EXMEM.instr)] - 
-                    		state.regFile[get_rt(newState.EXMEM.instr)]);
+    base = header.firstId;
+    cycle = shown = header.startCycle;
+    printf("Kanata\t0004\nC=\t%lld\n", cycle);
+    while (fread(&ev, sizeof(ev), 1, in) == 1) {
+        cycle += ev.delta;
+        if (ev.kind == EV_SKIP) {
+            cycle += ev.id;
+            continue;
+        }
+        value = 0;
+        if (ev.kind == EV_INSTR || ev.kind == EV_FETCH || ev.kind == EV_FORWARD) {
+            if (fread(&extra, sizeof(extra), 1, in) != 1 || extra.kind != EV_VALUE)
+                break;   /* truncated */
+            value = extra.id;
+        }
+        if (numPending > 0 && cycle > shown) {
+            printf("C\t1\n");
+            shown++;
+            for (j = 0; j < numPending; j++)
+                printf("R\t%u\t%lld\t0\n", pending[j] - base, retired++);
+            numPending = 0;
+        }
+        if (cycle > shown) {
+            printf("C\t%lld\n", cycle - shown);
+            shown = cycle;
+        }
+
+        if (ev.kind == EV_INSTR) {
+            if (ev.id / 4 >= numWords) {
+                size_t size = numWords ? numWords : 1024;
+                while (size <= ev.id / 4)
+                    size *= 2;
+                words = realloc(words, size * sizeof(unsigned int));
+                memset(words + numWords, 0, (size - numWords) * sizeof(unsigned int));
+                numWords = size;
+            }
+            words[ev.id / 4] = value;
+            continue;
+        }
+        if (ev.id == 0 || ev.id < base)
+            continue;    /* a fetch stall, or an instruction fetched before the trace started */
+
+        switch (ev.kind) {
+            case EV_FETCH:
+                printf("I\t%u\t%u\t0\n", ev.id - base, ev.id);
+                printf("L\t%u\t0\t%u: ", ev.id - base, value);
+                printInstruction(value / 4 < numWords ? words[value / 4] : 0);
+                printf("S\t%u\t0\t%s\n", ev.id - base, stages[STAGE_IF]);
+                break;
+            case EV_STAGE:
+                if (ev.arg < sizeof(stages) / sizeof(stages[0]))
+                    printf("S\t%u\t0\t%s\n", ev.id - base, stages[ev.arg]);
+                break;
+            case EV_STALL:
+                if (ev.arg < sizeof(stalls) / sizeof(stalls[0]))
+                    printf("L\t%u\t1\tcycle %lld: %s\\n\n", ev.id - base, cycle + 1, stalls[ev.arg]);
+                break;
+            case EV_FORWARD:
+                if (ev.arg < sizeof(paths) / sizeof(paths[0]))
+                    printf("L\t%u\t1\tcycle %lld: %s from %u\\n\n", ev.id - base, cycle + 1, paths[ev.arg], value);
+                if (value >= base)
+                    printf("W\t%u\t%u\t0\n", ev.id - base, value - base);
+                break;
+            case EV_BRANCH:
+                printf("L\t%u\t1\tcycle %lld: branch %s%s\\n\n", ev.id - base, cycle + 1,
+                    (ev.arg & 1) ? "taken" : "not taken", (ev.arg & 2) ? ", mispredicted" : "");
+                break;
+            case EV_RETIRE:
+                if (numPending == maxPending) {
+                    maxPending = maxPending ? 2 * maxPending : 2 * MAXWIDTH;
+                    pending = realloc(pending, maxPending * sizeof(unsigned int));
+                }
+                pending[numPending++] = ev.id;
+                break;
+            case EV_FLUSH:
+                printf("R\t%u\t0\t1\n", ev.id - base);
+                break;
+        }
+    }
+    if (numPending > 0) {
+        printf("C\t1\n");
+        for (j = 0; j < numPending; j++)
+            printf("R\t%u\t%lld\t0\n", pending[j] - base, retired++);
+    }
+
+    free(words);
+    free(pending);
+    fclose(in);
+    return(0);
+}
 
-                    break;
 
-                case HALT:
+/*************************************************************/
+/* The checker runs a reference model of the instruction set */
+/* alongside the pipeline. Every instruction that retires is */
+/* logged with its address and its register or memory        */
+/* effect; every CHECKBATCH of them, the reference model     */
+/* executes the same number of instructions on its own copy  */
+/* of the registers and data memory and compares the effects */
+/* one by one. The reference decodes the instruction words   */
+/* itself, so it shares neither the decoded instructions nor */
+/* any code with the pipeline models or the functional       */
+/* engine. The first difference is reported with the cycle   */
+/* the instruction retired in, and stops the simulation.     */
+/*************************************************************/
+
+/* Set up the reference model from the current architectural state */
+int initChecker(simType *sim)
+{
+    stateType *statePtr = &sim->state;
+    pipeType *pipe = &statePtr->pipe[statePtr->cur];
+    checkerType *checker;
+    int i;
 
-                	newState.EXMEM.writeReg = 0;
+    checker = malloc(sizeof(checkerType));
+    checker->dataMem = allocMemory(4 * (size_t)statePtr->numDataMem);
+    if (checker->dataMem == NULL) {
+        free(checker);
+        return(1);
+    }
+    memcpy(checker->dataMem, statePtr->dataMem, 4 * (size_t)statePtr->numDataMem);
+    checker->numDataMem = statePtr->numDataMem;
+    memcpy(checker->regFile, statePtr->regFile, sizeof(checker->regFile));
+    checker->instrMem = statePtr->instrMem;
+    checker->numInstrMem = statePtr->numInstrMem;
+    checker->checked = 0;
+    checker->numLog = 0;
+
+    /* A restored checkpoint may have instructions in flight; the */
+    /* oldest of them is the next one to retire                  */
+    checker->PC = statePtr->PC;
+    for (i = 3 * statePtr->width - 1; i >= 0; i--) {
+        int instr = (i < statePtr->width) ? pipe->EXMEM[i].instr
+            : (i < 2 * statePtr->width) ? pipe->IDEX[i - statePtr->width].instr
+            : pipe->IFID[i - 2 * statePtr->width].instr;
+        if (instr != NOOPINDEX)
+            checker->PC = DECODEDPC(instr);
+    }
+    sim->checker = checker;
+    return(0);
+}
 
-                	newState.EXMEM.writeDataReg = 0;
+void freeChecker(checkerType *checker)
+{
+    if (checker == NULL)
+        return;
+    freeMemory(checker->dataMem, 4 * (size_t)checker->numDataMem);
+    free(checker);
+}
 
-                	newState.EXMEM.aluResult = 0;
+/* Log an instruction at pc retiring with operation op: loads, adds */
+/* and subtracts have written reg, stores have written addr         */
+void logRetire(simType *sim, int pc, int op, int reg, int addr)
+{
+    checkerType *checker = sim->checker;
+    retireType *r = &checker->log[checker->numLog++];
+
+    r->cycle = sim->state.cycles + 1;
+    r->pc = pc;
+    r->reg = (op == OP_LW || op == OP_ADD || op == OP_SUB) ? reg : -1;
+    r->addr = (op == OP_SW) ? addr : -1;
+    r->value = (r->reg >= 0) ? sim->state.regFile[reg] : (r->addr >= 0) ? sim->state.dataMem[addr / 4] : 0;
+    if (checker->numLog >= CHECKBATCH)
+        checkRetired(sim);
+}
 
-                	break;
+/* Check the logged instructions. Returns nonzero, and marks the */
+/* state as faulted, at the first one that differs.              */
+int checkRetired(simType *sim)
+{
+    checkerType *checker = sim->checker;
+    retireType *r, expected;
+    char got[96], want[96];
+    int i, status;
+
+    for (i = 0; i < checker->numLog; i++) {
+        r = &checker->log[i];
+        status = stepReference(checker, &expected);
+        if (status == 0 && r->pc == expected.pc && r->reg == expected.reg
+            && r->addr == expected.addr && r->value == expected.value)
+            continue;
+        describeRetire(checker, r, got, sizeof(got));
+        if (status == 0)
+            describeRetire(checker, &expected, want, sizeof(want));
+        else
+            snprintf(want, sizeof(want), "pc %d: %s", checker->PC,
+                status == 1 ? "halt or end of instruction memory" : "load or store out of range");
+        fprintf(stderr, "error: instruction %lld, retired in cycle %lld, differs from the reference model\n",
+            checker->checked + (status == 0), r->cycle);
+        fprintf(stderr, "\tpipeline:  %s\n\treference: %s\n", got, want);
+        checker->numLog = 0;
+        sim->state.fault = 1;
+        return(1);
+    }
+    checker->numLog = 0;
+    return(0);
+}
 
-                case R:
+/* Check the logged instructions, then let the reference model execute */
+/* the count instructions the functional engine has just executed      */
+int skipChecker(simType *sim, long long count)
+{
+    checkerType *checker = sim->checker;
+    retireType expected;
+
+    if (checkRetired(sim) != 0)
+        return(1);
+    for (; count > 0; count--) {
+        if (stepReference(checker, &expected) != 0) {
+            fprintf(stderr, "error: the functional engine executed %lld instructions more than the reference model,\n"
+                "\twhich stopped at pc %d after %lld instructions\n", count, checker->PC, checker->checked);
+            sim->state.fault = 1;
+            return(1);
+        }
+    }
+    return(0);
+}
 
-                    	newState.EXMEM.writeReg = get_rd(newState.EXMEM.instr);
+/* Check the rest of the log, then that the program stopped where */
+/* the reference model does: at the same load or store out of     */
+/* range, or else with the same registers and data memory         */
+int finishChecker(simType *sim)
+{
+    checkerType *checker = sim->checker;
+    stateType *statePtr = &sim->state;
+    retireType expected;
+    int i, stopped;
+
+    if (checkRetired(sim) != 0)
+        return(1);
+    if (statePtr->fault) {
+        if (stepReference(checker, &expected) != 2)
+            fprintf(stderr, "error: after %lld instructions, the reference model continues at pc %d\n"
+                "\twithout a load or store out of range\n", checker->checked, checker->PC);
+        return(1);
+    }
+    if (sim->config->functional)
+        stopped = (checker->PC == statePtr->PC);
+    else
+        stopped = checker->PC < 0 || checker->PC / 4 >= checker->numInstrMem
+            || get_opcode(checker->instrMem[checker->PC / 4]) == HALT;
+    if (!stopped) {
+        fprintf(stderr, "error: the simulation stopped after %lld instructions, but the reference model\n"
+            "\tcontinues at pc %d\n", checker->checked, checker->PC);
+        statePtr->fault = 1;
+    }
+    for (i = 0; i < NUMREGS; i++) {
+        if (statePtr->regFile[i] != checker->regFile[i]) {
+            fprintf(stderr, "error: at the end, reg[ %d ] is %d, but %d in the reference model\n",
+                i, statePtr->regFile[i], checker->regFile[i]);
+            statePtr->fault = 1;
+        }
+    }
+    for (i = 0; i < statePtr->numDataMem; i++) {
+        if (statePtr->dataMem[i] != checker->dataMem[i]) {
+            fprintf(stderr, "error: at the end, dataMem[ %d ] is %d, but %d in the reference model\n",
+                i, statePtr->dataMem[i], checker->dataMem[i]);
+            statePtr->fault = 1;
+            break;
+        }
+    }
+    return(statePtr->fault);
+}
 
-                    	newState.EXMEM.writeDataReg = get_rt(newState.EXMEM.instr);
-       
-                    switch(get_funct(newState.EXMEM.instr)) {
-       
-                        case ADD:
+/* Execute the instruction at the reference PC and describe its effect */
+/* in r. Returns 1, without executing it, at a HALT or past the end of */
+/* instruction memory, and 2 if a load or store is out of range.       */
+int stepReference(checkerType *checker, retireType *r)
+{
+    unsigned int instr;
+    int pc = checker->PC;
+    int *regFile = checker->regFile;
+
+    if (pc < 0 || pc / 4 >= checker->numInstrMem)
+        return(1);
+    instr = checker->instrMem[pc / 4];
+    r->pc = pc;
+    r->reg = -1;
+    r->addr = -1;
+    r->value = 0;
+    switch (get_opcode(instr)) {
+        case R:
+            if (get_funct(instr) == ADD || get_funct(instr) == SUB) {
+                r->reg = get_rd(instr);
+                if (get_funct(instr) == ADD)
+                    r->value = regFile[get_rs(instr)] + regFile[get_rt(instr)];
+                else
+                    r->value = regFile[get_rs(instr)] - regFile[get_rt(instr)];
+                regFile[r->reg] = r->value;
+            }
+            break;
+        case LW:
+        case SW:
+            r->addr = regFile[get_rs(instr)] + get_immed(instr);
+            if (r->addr < 0 || r->addr / 4 >= checker->numDataMem)
+                return(2);
+            if (get_opcode(instr) == SW) {
+                r->value = checker->dataMem[r->addr / 4] = regFile[get_rt(instr)];
+            } else {
+                r->reg = get_rt(instr);
+                r->value = regFile[r->reg] = checker->dataMem[r->addr / 4];
+                r->addr = -1;
+            }
+            break;
+        case BNE:
+            if (regFile[get_rs(instr)] != regFile[get_rt(instr)])
+                pc += get_immed(instr) << 2;
+            break;
+        case HALT:
+            return(1);
+    }
+    checker->PC = pc + 4;
+    checker->checked++;
+    return(0);
+}
 
-                            newState.EXMEM.aluResult = (state.IDEX.readData1) + (state.IDEX.readData2);
+/* Format a retired instruction and its effect */
+void describeRetire(checkerType *checker, retireType *r, char *buf, size_t size)
+{
+    int n = snprintf(buf, size, "pc %d (0x%08x)", r->pc,
+        r->pc >= 0 && r->pc / 4 < checker->numInstrMem ? checker->instrMem[r->pc / 4] : 0);
+
+    if (r->reg >= 0)
+        snprintf(buf + n, size - n, " wrote %d to reg[ %d ]", r->value, r->reg);
+    else if (r->addr >= 0)
+        snprintf(buf + n, size - n, " stored %d to address %d", r->value, r->addr);
+    else
+        snprintf(buf + n, size - n, " wrote nothing");
+}
 
-                            break;
+/*************************************************************/
+/* The runFunctional function executes up to maxInstrs       */
+/* instructions (all of them if maxInstrs is negative)       */
+/* directly on the architectural state, without modeling the */
+/* pipeline. It stops before a HALT, at the end of           */
+/* instruction memory, or before a load or store that        */
+/* faults, and returns the number executed.                  */
+/* Most of the instructions run as translated blocks in      */
+/* runBlocks; this interpreter finishes what they leave.     */
+/* With GCC-compatible compilers each handler jumps straight */
+/* to the next one through a table indexed by the decoded    */
+/* operation (threaded dispatch); otherwise it uses a switch. */
+/*************************************************************/
+long long runFunctional(stateType *statePtr, long long maxInstrs)
+{
+    decodedType *dec;
+    int *regFile = statePtr->regFile;
+    int pc = statePtr->PC;
+    int addr;
+    long long count;
+
+    if (maxInstrs < 0)
+        maxInstrs = -1ULL >> 1;
+    count = runBlocks(statePtr, maxInstrs);
+    pc = statePtr->PC;
+
+#define FETCH() \
+    if (count == maxInstrs || pc < 0 || pc / 4 >= statePtr->numInstrMem) \
+        goto done; \
+    dec = &statePtr->decodedMem[DECODEDINDEX(pc)]; \
+    count++
+
+#ifdef __GNUC__
+    static void *handlers[] = {
+        [OP_NOOP] = &&noop, [OP_ADD] = &&add, [OP_SUB] = &&sub, [OP_LW] = &&lw,
+        [OP_SW] = &&sw, [OP_BNE] = &&bne, [OP_HALT] = &&halt
+    };
+#define HANDLER(op, label) label:
+#define NEXT() FETCH(); goto *handlers[dec->op]
+    NEXT();
+#else
+#define HANDLER(op, label) case op:
+#define NEXT() continue
+    for (;;) {
+    FETCH();
+    switch (dec->op) {
+#endif
+
+    HANDLER(OP_NOOP, noop)
+        pc += 4;
+        NEXT();
+
+    HANDLER(OP_ADD, add)
+        regFile[dec->rd] = regFile[dec->rs] + regFile[dec->rt];
+        pc += 4;
+        NEXT();
+
+    HANDLER(OP_SUB, sub)
+        regFile[dec->rd] = regFile[dec->rs] - regFile[dec->rt];
+        pc += 4;
+        NEXT();
+
+    HANDLER(OP_LW, lw)
+        addr = regFile[dec->rs] + dec->immed;
+        if (checkDataAddr(statePtr, addr))
+            goto fault;
+        regFile[dec->rt] = statePtr->dataMem[addr / 4];
+        pc += 4;
+        NEXT();
+
+    HANDLER(OP_SW, sw)
+        addr = regFile[dec->rs] + dec->immed;
+        if (checkDataAddr(statePtr, addr))
+            goto fault;
+        statePtr->dataMem[addr / 4] = regFile[dec->rt];
+        pc += 4;
+        NEXT();
+
+    HANDLER(OP_BNE, bne)
+        pc += 4;
+        if (regFile[dec->rs] != regFile[dec->rt])
+            pc += dec->immed << 2;
+        NEXT();
+
+    HANDLER(OP_HALT, halt)
+    fault:
+        count--;
+        goto done;
+
+#ifndef __GNUC__
+    }
+    }
+#endif
+#undef FETCH
+#undef HANDLER
+#undef NEXT
+
+done:
+    statePtr->PC = pc;
+    return(count);
+}
 
-                        case SUB:
+/*************************************************************/
+/* The runBlocks function is the fast path of runFunctional. */
+/* It executes whole translated basic blocks (see            */
+/* translateBlock), dispatching only on the loads, stores,   */
+/* adds and subtracts in them, and checking the instruction  */
+/* count and the PC once per block rather than once per      */
+/* instruction. Each block remembers the blocks its branch   */
+/* led to, so loops run from block to block without going    */
+/* back to the cache. It stops before a block that would go  */
+/* past maxInstrs, before a load or store that would fault,  */
+/* at a HALT or the end of instruction memory, and leaves    */
+/* the rest to the interpreter. Returns the number of        */
+/* instructions executed and updates PC.                     */
+/*************************************************************/
+long long runBlocks(stateType *statePtr, long long maxInstrs)
+{
+    blockType *b;
+    uopType *u;
+    int *regFile = statePtr->regFile;
+    int *dataMem = statePtr->dataMem;
+    int numDataMem = statePtr->numDataMem;
+    int pc = statePtr->PC;
+    int addr;
+    long long count = 0;
+
+    if (statePtr->blocks == NULL
+        && (statePtr->blocks = calloc(statePtr->numInstrMem, sizeof(blockType *))) == NULL)
+        return(0);
+
+/* Go on with the block at address target, found once through link */
+#define ENTER(link, target) \
+    pc = (target); \
+    if ((link) == NULL) \
+        (link) = findBlock(statePtr, pc); \
+    b = (link); \
+    if (b == NULL || count + b->length > maxInstrs) \
+        goto done; \
+    count += b->length; \
+    u = b->ops
+
+#ifdef __GNUC__
+    static void *handlers[] = {
+        [XOP_ADD] = &&add, [XOP_SUB] = &&sub, [XOP_LW] = &&lw, [XOP_SW] = &&sw,
+        [XOP_BNE] = &&bne, [XOP_NEXT] = &&next, [XOP_EXIT] = &&exit
+    };
+#define HANDLER(op, label) label:
+#define DISPATCH() goto *handlers[u->op]
+#define NEXT() u++; DISPATCH()
+    b = NULL;
+    ENTER(b, pc);
+    DISPATCH();
+#else
+#define HANDLER(op, label) case op:
+#define DISPATCH() continue
+#define NEXT() u++; continue
+    b = NULL;
+    ENTER(b, pc);
+    for (;;) {
+    switch (u->op) {
+#endif
+
+    HANDLER(XOP_ADD, add)
+        regFile[u->rd] = regFile[u->rs] + regFile[u->rt];
+        NEXT();
+
+    HANDLER(XOP_SUB, sub)
+        regFile[u->rd] = regFile[u->rs] - regFile[u->rt];
+        NEXT();
+
+    HANDLER(XOP_LW, lw)
+        addr = regFile[u->rs] + u->immed;
+        if (addr < 0 || addr / 4 >= numDataMem)
+            goto fault;
+        regFile[u->rt] = dataMem[addr / 4];
+        NEXT();
+
+    HANDLER(XOP_SW, sw)
+        addr = regFile[u->rs] + u->immed;
+        if (addr < 0 || addr / 4 >= numDataMem)
+            goto fault;
+        dataMem[addr / 4] = regFile[u->rt];
+        NEXT();
+
+    HANDLER(XOP_BNE, bne)
+        if (regFile[u->rs] != regFile[u->rt]) {
+            ENTER(b->taken, b->takenPc);
+        } else {
+            ENTER(b->fallThrough, b->nextPc);
+        }
+        DISPATCH();
 
-                        newState.EXMEM.aluResult = 
-((state.IDEX.readData2) - (state.IDEX.readData1));
+    HANDLER(XOP_NEXT, next)
+        ENTER(b->fallThrough, b->nextPc);
+        DISPATCH();
 
-                            break;
+    HANDLER(XOP_EXIT, exit)
+        pc = b->nextPc;
+        goto done;
 
-                    }
+#ifndef __GNUC__
+    }
+    }
+#endif
+#undef ENTER
+#undef HANDLER
+#undef DISPATCH
+#undef NEXT
+
+fault:
+    /* Back up to the load or store, which the interpreter reports */
+    count -= b->length - u->offset;
+    pc = b->pc + 4 * u->offset;
+
+done:
+    statePtr->PC = pc;
+    return(count);
+}
 
-            }
+/*************************************************************/
+/* The findBlock function returns the translated block that  */
+/* starts at pc, translating it the first time. Returns NULL */
+/* if pc is outside instruction memory or the block cannot   */
+/* be allocated.                                             */
+/*************************************************************/
+blockType *findBlock(stateType *statePtr, int pc)
+{
+    if (pc < 0 || pc % 4 != 0 || pc / 4 >= statePtr->numInstrMem)
+        return(NULL);
+    if (statePtr->blocks[pc / 4] == NULL)
+        statePtr->blocks[pc / 4] = translateBlock(statePtr, pc);
+    return(statePtr->blocks[pc / 4]);
+}
 
-        /* --------------------- MEM stage --------------------- */
+/*************************************************************/
+/* The translateBlock function translates the basic block    */
+/* starting at pc: the instructions up to and including the  */
+/* next BNE, or up to a HALT or the end of instruction       */
+/* memory, or BLOCKMAX instructions. NOOPs are dropped, and  */
+/* the block ends in an operation that says where execution  */
+/* goes next. Instruction memory is never stored to (loads   */
+/* and stores only reach dataMem), so blocks stay valid      */
+/* until the state is freed.                                 */
+/*************************************************************/
+blockType *translateBlock(stateType *statePtr, int pc)
+{
+    decodedType *dec = &statePtr->decodedMem[DECODEDINDEX(pc)];
+    int avail = statePtr->numInstrMem - pc / 4;
+    blockType *b;
+    uopType *u;
+    int n, op, last = OP_NOOP;
+
+    for (n = 0; n < avail && n < BLOCKMAX; n++) {
+        last = dec[n].op;
+        if (last == OP_HALT)
+            break;
+        if (last == OP_BNE) {
+            n++;
+            break;
+        }
+    }
 
-        newState.MEMWB.instr = state.EXMEM.instr;
- 
-        switch(get_opcode(newState.MEMWB.instr)) {
-        	
-        	case LW:
-        	    
-        	    newState.MEMWB.writeDataALU = state.EXMEM.aluResult;
-
-        		newState.MEMWB.writeReg = state.EXMEM.writeReg;
-        	
-        		newState.MEMWB.writeDataMem = state.dataMem[((state.EXMEM.aluResult) / 4)];
-        	
-        		break;
-        	
-        	case SW:
-        	    
-        	    newState.MEMWB.writeDataALU = state.EXMEM.aluResult;
-
-        		newState.MEMWB.writeReg = state.EXMEM.writeReg;
-
-				newState.dataMem[(((state.EXMEM.aluResult) / 4))] = state.regFile[state.EXMEM.writeReg];
-                
+    if ((b = malloc(sizeof(blockType) + sizeof(uopType) * (n + 1))) == NULL)
+        return(NULL);
+    b->pc = pc;
+    b->length = n;
+    b->nextPc = pc + 4 * n;
+    b->takenPc = 0;
+    b->taken = b->fallThrough = NULL;
+    u = b->ops;
+    for (n = 0; n < b->length; n++) {
+        switch (dec[n].op) {
+            case OP_ADD: op = XOP_ADD; break;
+            case OP_SUB: op = XOP_SUB; break;
+            case OP_LW:  op = XOP_LW;  break;
+            case OP_SW:  op = XOP_SW;  break;
+            case OP_BNE:
+                op = XOP_BNE;
+                b->takenPc = b->nextPc + (dec[n].immed << 2);
                 break;
+            default:
+                continue;
+        }
+        u->op = op;
+        u->rs = dec[n].rs;
+        u->rt = dec[n].rt;
+        u->rd = dec[n].rd;
+        u->immed = dec[n].immed;
+        u->offset = n;
+        u++;
+    }
+    if (last != OP_BNE) {
+        u->op = (b->length == BLOCKMAX) ? XOP_NEXT : XOP_EXIT;
+        u->offset = b->length;
+    }
+    return(b);
+}
 
-            case HALT:
+/* Free the translated blocks, if any */
+void freeBlocks(stateType *statePtr)
+{
+    int i;
 
-            	newState.MEMWB.writeDataALU = 0;
+    if (statePtr->blocks == NULL)
+        return;
+    for (i = 0; i < statePtr->numInstrMem; i++)
+        free(statePtr->blocks[i]);
+    free(statePtr->blocks);
+    statePtr->blocks = NULL;
+}
 
-            	newState.MEMWB.writeReg = 0;
-	
-				break;
+/*************************************************************/
+/* The initPredictor function allocates the counter tables   */
+/* and branch target buffer for the configured predictor.    */
+/* Counters start out weakly not taken, and the tournament   */
+/* chooser starts out weakly favoring the bimodal table.     */
+/*************************************************************/
+void initPredictor(predictorType *pred, configType *config)
+{
+    int i;
 
-			case BNE:
+    memset(pred, 0, sizeof(*pred));
+    pred->type = config->bpType;
+    pred->mask = config->bpEntries - 1;
+    pred->btbMask = config->btbEntries - 1;
+    if (pred->type == BP_NOTTAKEN)
+        return;
+
+    pred->bimodal = malloc(config->bpEntries);
+    pred->gshare = malloc(config->bpEntries);
+    pred->chooser = malloc(config->bpEntries);
+    memset(pred->bimodal, WEAKLYNOTTAKEN, config->bpEntries);
+    memset(pred->gshare, WEAKLYNOTTAKEN, config->bpEntries);
+    memset(pred->chooser, WEAKLYNOTTAKEN, config->bpEntries);
+
+    pred->btb = malloc(sizeof(btbEntryType) * config->btbEntries);
+    for (i = 0; i < config->btbEntries; i++)
+        pred->btb[i].pc = -1;
+}
 
-				newState.MEMWB.writeDataALU = state.EXMEM.aluResult;
+void freePredictor(predictorType *pred)
+{
+    free(pred->bimodal);
+    free(pred->gshare);
+    free(pred->chooser);
+    free(pred->btb);
+}
 
-				newState.MEMWB.writeReg = state.EXMEM.writeReg;
+/*************************************************************/
+/* The predictBranch function is consulted in IF for the     */
+/* instruction at pc. It returns nonzero and sets *target if */
+/* the direction predictor says taken and the BTB holds a    */
+/* target for pc. *hist is set to the global history used,   */
+/* which travels down the pipeline with the branch so that   */
+/* updatePredictor trains the same gshare entry.             */
+/*************************************************************/
+int predictBranch(predictorType *pred, int pc, unsigned int *hist, int *target)
+{
+    unsigned int index = (unsigned int)pc >> 2;
+    btbEntryType *entry;
+    int taken;
+
+    *hist = pred->history;
+    switch (pred->type) {
+        case BP_BIMODAL:
+            taken = pred->bimodal[index & pred->mask] >= WEAKLYTAKEN;
+            break;
+        case BP_GSHARE:
+            taken = pred->gshare[(index ^ pred->history) & pred->mask] >= WEAKLYTAKEN;
+            break;
+        case BP_TOURNAMENT:
+            if (pred->chooser[index & pred->mask] >= WEAKLYTAKEN)
+                taken = pred->gshare[(index ^ pred->history) & pred->mask] >= WEAKLYTAKEN;
+            else
+                taken = pred->bimodal[index & pred->mask] >= WEAKLYTAKEN;
+            break;
+        default:
+            return(0);
+    }
+    if (!taken)
+        return(0);
+
+    entry = &pred->btb[index & pred->btbMask];
+    if (entry->pc != pc)
+        return(0);
+    *target = entry->target;
+    return(1);
+}
 
-				newState.MEMWB.writeDataMem = state.EXMEM.writeDataReg;
+/* Move a 2-bit saturating counter towards taken or not taken */
+#define TRAIN(counter, taken) \
+    ((counter) = (taken) ? ((counter) < STRONGLYTAKEN ? (counter) + 1 : STRONGLYTAKEN) \
+                         : ((counter) > STRONGLYNOTTAKEN ? (counter) - 1 : STRONGLYNOTTAKEN))
 
-				if(newState.MEMWB.writeDataALU != 0) {
+/*************************************************************/
+/* The updatePredictor function trains the predictor with a  */
+/* branch resolved in EX: the counters, the tournament       */
+/* chooser (towards whichever table was right, if only one   */
+/* was), the global history, and the BTB for taken branches. */
+/*************************************************************/
+void updatePredictor(predictorType *pred, int pc, unsigned int hist, int taken, int target)
+{
+    unsigned int index = (unsigned int)pc >> 2;
+    unsigned char *bimodal, *gshare, *chooser;
 
-					// newState.IFID.instr = state.IFID.instr;
+    if (pred->type == BP_NOTTAKEN)
+        return;
 
-                	// newState.PC = newState.IDEX.immed;
+    bimodal = &pred->bimodal[index & pred->mask];
+    gshare = &pred->gshare[(index ^ hist) & pred->mask];
+    chooser = &pred->chooser[index & pred->mask];
 
-                	// newState.IFID.PCPlus4 = newState.PC + 4;
+    if (pred->type == BP_TOURNAMENT && ((*bimodal >= WEAKLYTAKEN) != (*gshare >= WEAKLYTAKEN)))
+        TRAIN(*chooser, (*gshare >= WEAKLYTAKEN) == taken);
+    if (pred->type != BP_GSHARE)
+        TRAIN(*bimodal, taken);
+    if (pred->type != BP_BIMODAL)
+        TRAIN(*gshare, taken);
 
-                	numBranches++;
+    pred->history = ((pred->history << 1) | (taken != 0)) & pred->mask;
 
-				}
-        	
-        	default:
+    if (taken) {
+        pred->btb[index & pred->btbMask].pc = pc;
+        pred->btb[index & pred->btbMask].target = target;
+    }
+}
 
-        	    int temp = ((newState.MEMWB.instr)& 0x0000FFFF);
+/*************************************************************/
+/* The initCaches function builds the memory hierarchy from  */
+/* the configuration: each configured level is linked to the */
+/* next one down, the last to main memory. Absent levels     */
+/* have no tag array. Lines start out invalid.               */
+/*************************************************************/
+void initCaches(cacheType *cache, configType *config)
+{
+    cacheType *next = NULL;
+    int level, lines;
+
+    memset(cache, 0, sizeof(cacheType) * NUMCACHES);
+    for (level = NUMCACHES - 1; level >= 0; level--) {
+        cacheConfigType *geom = &config->cache[level];
+        if (geom->size == 0)
+            continue;
+        lines = geom->size / geom->line;
+        cache[level].tags = calloc(lines, sizeof(unsigned int));
+        cache[level].stamps = calloc(lines, sizeof(unsigned int));
+        cache[level].dirty = calloc(lines, 1);
+        cache[level].ways = geom->ways;
+        for (cache[level].lineShift = 0; (1 << cache[level].lineShift) < geom->line; cache[level].lineShift++)
+            ;
+        cache[level].setMask = lines / geom->ways - 1;
+        cache[level].latency = geom->latency;
+        cache[level].replacement = config->replacement;
+        cache[level].writeThrough = (level == CACHE_L1D && config->writeThrough);
+        cache[level].seed = 2463534242u;
+        cache[level].next = next;
+        cache[level].memLatency = config->memLatency;
+        if (level == CACHE_L2)
+            next = &cache[level];
+    }
+}
 
-        		if(temp != 0) {
+void freeCaches(cacheType *cache)
+{
+    int level;
 
-        			newState.MEMWB.writeDataALU = state.EXMEM.aluResult;
+    for (level = 0; level < NUMCACHES; level++) {
+        free(cache[level].tags);
+        free(cache[level].stamps);
+        free(cache[level].dirty);
+    }
+}
 
-        			newState.MEMWB.writeReg = state.EXMEM.writeReg;
+/*************************************************************/
+/* The cacheAccess function looks up the byte address addr   */
+/* (with INSTRSPACE set for instructions) in cache, fills    */
+/* the line from the next level on a miss, and returns the   */
+/* extra cycles the access takes beyond a single-cycle       */
+/* memory. Write-back caches mark the line                   */
+/* dirty and write it to the next level when it is evicted.  */
+/* Write-through caches pass every write on and do not       */
+/* allocate on a write miss; writes are buffered, so they    */
+/* never stall, and neither do write-backs.                  */
+/*************************************************************/
+int cacheAccess(cacheType *cache, unsigned int addr, int write)
+{
+    unsigned int line = (addr >> cache->lineShift) + 1;
+    unsigned int base = (line & cache->setMask) * cache->ways;
+    unsigned int *tags = &cache->tags[base];
+    int way, victim, penalty;
+
+    cache->clock++;
+    for (way = 0; way < cache->ways; way++)
+        if (tags[way] == line)
+            break;
+
+    if (way < cache->ways) {
+        cache->stats.hits++;
+        if (cache->replacement == REPL_LRU)
+            cache->stamps[base + way] = cache->clock;
+        if (write && cache->writeThrough && cache->next != NULL)
+            cacheAccess(cache->next, addr, 1);
+        else if (write)
+            cache->dirty[base + way] = 1;
+        return(cache->latency);
+    }
 
-        		}
+    cache->stats.misses++;
+    if (write && cache->writeThrough) {
+        if (cache->next != NULL)
+            cacheAccess(cache->next, addr, 1);
+        return(cache->latency);
+    }
+    penalty = cache->latency + (cache->next != NULL ? cacheAccess(cache->next, addr, 0) : cache->memLatency);
+
+    /* Choose a victim: an invalid way if there is one, else by the replacement policy */
+    for (victim = 0; victim < cache->ways && tags[victim] != 0; victim++)
+        ;
+    if (victim == cache->ways) {
+        if (cache->replacement == REPL_RANDOM) {
+            cache->seed ^= cache->seed << 13;
+            cache->seed ^= cache->seed >> 17;
+            cache->seed ^= cache->seed << 5;
+            victim = cache->seed % cache->ways;
+        } else {
+            for (victim = 0, way = 1; way < cache->ways; way++)
+                if (cache->clock - cache->stamps[base + way] > cache->clock - cache->stamps[base + victim])
+                    victim = way;
+        }
+        cache->stats.evictions++;
+        if (cache->dirty[base + victim]) {
+            cache->stats.writebacks++;
+            if (cache->next != NULL)
+                cacheAccess(cache->next, (tags[victim] - 1) << cache->lineShift, 1);
+        }
+    }
+    tags[victim] = line;
+    cache->stamps[base + victim] = cache->clock;
+    cache->dirty[base + victim] = (unsigned char)(write != 0);
+    return(penalty);
+}
 
-        		break;
-        
+/*************************************************************/
+/* The cacheInvalidate function drops the line holding addr  */
+/* from cache, counting a write-back if it was dirty.        */
+/* Returns nonzero if the line was there.                    */
+/*************************************************************/
+int cacheInvalidate(cacheType *cache, unsigned int addr)
+{
+    unsigned int line = (addr >> cache->lineShift) + 1;
+    unsigned int base = (line & cache->setMask) * cache->ways;
+    int way;
+
+    for (way = 0; way < cache->ways; way++) {
+        if (cache->tags[base + way] == line) {
+            cache->tags[base + way] = 0;
+            if (cache->dirty[base + way])
+                cache->stats.writebacks++;
+            cache->dirty[base + way] = 0;
+            return(1);
         }
+    }
+    return(0);
+}
+
+/******************************************************************/
+/* The assembler reads a whole program into memory (mapped when   */
+/* it is a regular file) and makes two passes over it: the first  */
+/* assigns addresses to labels, the second encodes instructions   */
+/* and data. Tokens are pointers into the buffer, so nothing is   */
+/* copied until the symbol names are saved at the end. Each line  */
+/* has the form                                                   */
+/*     [label:] [mnemonic operands | .directive values] [# ...]   */
+/* with the mnemonics add, sub, lw, sw, bne, halt and noop, and   */
+/* the directives .word (or .fill) v1,v2,... and .space bytes.    */
+/* Labels on instructions are instruction addresses and labels on */
+/* directives are data addresses. An immediate or .word value may */
+/* be a number or a label; a bne target that is a label becomes   */
+/* the PC-relative offset to it. Anything after halt or noop is   */
+/* ignored, as the original loader did.                           */
+/******************************************************************/
+
+/* Report an error at the current line and count it */
+void asmError(asmType *a, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (a->errors++ >= 20)
+        return;
+    fprintf(stderr, "%s:%d: error: ", a->name, a->line);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "\n");
+}
+
+void skipSpace(asmType *a)
+{
+    while (a->p < a->end && (*a->p == ' ' || *a->p == '\t' || *a->p == '\r'))
+        a->p++;
+}
+
+/* Returns nonzero if only a comment or nothing is left on the line */
+int atLineEnd(asmType *a)
+{
+    skipSpace(a);
+    return(a->p == a->end || *a->p == '#' || *a->p == ';');
+}
 
-        /* --------------------- WB stage --------------------- */
+/* Consume the character c, reporting an error if it is not next */
+int expectChar(asmType *a, char c)
+{
+    skipSpace(a);
+    if (a->p < a->end && *a->p == c) {
+        a->p++;
+        return(1);
+    }
+    asmError(a, "expected '%c'", c);
+    return(0);
+}
 
-        switch(get_opcode(newState.MEMWB.instr)) {
+/* Parse an identifier: a letter, '_' or '.' followed by letters, digits, '_' or '.' */
+int parseIdent(asmType *a, const char **name, int *len)
+{
+    const char *start;
+
+    skipSpace(a);
+    start = a->p;
+    if (a->p < a->end && (isalpha((unsigned char)*a->p) || *a->p == '_' || *a->p == '.'))
+        for (a->p++; a->p < a->end && (isalnum((unsigned char)*a->p) || *a->p == '_' || *a->p == '.'); a->p++)
+            ;
+    *name = start;
+    *len = (int)(a->p - start);
+    return(*len > 0);
+}
 
-        	case LW:
+/* Parse a decimal or 0x hexadecimal integer with an optional sign */
+int parseNumber(asmType *a, long long *value)
+{
+    int neg = 0, base = 10, digits = 0, d;
+
+    skipSpace(a);
+    if (a->p < a->end && (*a->p == '-' || *a->p == '+'))
+        neg = (*a->p++ == '-');
+    if (a->end - a->p > 2 && a->p[0] == '0' && (a->p[1] == 'x' || a->p[1] == 'X')
+        && isxdigit((unsigned char)a->p[2])) {
+        base = 16;
+        a->p += 2;
+    }
+    *value = 0;
+    for (; a->p < a->end && isxdigit((unsigned char)*a->p); a->p++, digits++) {
+        d = isdigit((unsigned char)*a->p) ? *a->p - '0' : (tolower((unsigned char)*a->p) - 'a' + 10);
+        if (d >= base)
+            break;
+        if (*value <= 0xFFFFFFFFLL)
+            *value = *value * base + d;
+    }
+    if (neg)
+        *value = -*value;
+    return(digits > 0);
+}
 
-        		newState.regFile[newState.MEMWB.writeReg] = newState.MEMWB.writeDataMem;
+/* Parse a register $0 .. $(NUMREGS-1) */
+int parseReg(asmType *a, int *reg)
+{
+    long long value;
 
-        		break;
+    if (!expectChar(a, '$'))
+        return(0);
+    if (!parseNumber(a, &value) || value < 0 || value >= NUMREGS) {
+        asmError(a, "expected a register $0 to $%d", NUMREGS - 1);
+        return(0);
+    }
+    *reg = (int)value;
+    return(1);
+}
 
-        	case HALT:
+/* Find a symbol, returning its slot in the hash table (empty if it is not defined) */
+symbolType *findSymbol(asmType *a, const char *name, int len)
+{
+    unsigned int hash = 2166136261u;
+    int i;
 
-        		newState.MEMWB.writeDataALU = 0;
-    			
-    			newState.MEMWB.writeReg = 0;
+    for (i = 0; i < len; i++)
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    for (i = hash & a->symMask; ; i = (i + 1) & a->symMask)
+        if (a->symbols[i].name == NULL
+            || (a->symbols[i].len == len && memcmp(a->symbols[i].name, name, len) == 0))
+            return(&a->symbols[i]);
+}
 
-        		break;
+/* Define a label in pass 1; its address is filled in by the next instruction or directive */
+void defineLabel(asmType *a, const char *name, int len)
+{
+    symbolType *old, *sym;
+    int i, size;
+
+    if (2 * (a->numSymbols + 1) > a->symMask + 1) {
+        old = a->symbols;
+        size = 2 * (a->symMask + 1);
+        a->symbols = calloc(size, sizeof(symbolType));
+        a->symMask = size - 1;
+        for (i = 0; i < size / 2; i++)
+            if (old[i].name != NULL)
+                *findSymbol(a, old[i].name, old[i].len) = old[i];
+        free(old);
+    }
+    sym = findSymbol(a, name, len);
+    if (sym->name != NULL) {
+        asmError(a, "label '%.*s' already defined on line %d", len, name, sym->line);
+        return;
+    }
+    sym->name = name;
+    sym->len = len;
+    sym->line = a->line;
+    sym->value = -1;
+    a->numSymbols++;
+    a->pending = realloc(a->pending, sizeof(symbolType*) * a->numSymbols);
+    a->pending[a->numPending++] = sym;
+}
 
-        	case R:
+/* Give the labels waiting for an address the next instruction or data address */
+void bindLabels(asmType *a, int isData)
+{
+    int i;
 
-        		int temp = ((newState.MEMWB.instr)& 0x0000FFFF);
+    for (i = 0; i < a->numPending; i++) {
+        a->pending[i]->isData = isData;
+        a->pending[i]->value = 4 * (isData ? a->numData : a->numInstr);
+    }
+    a->numPending = 0;
+}
 
-        		if(temp != 0) {
+/* Parse a number or a label. In pass 1 labels are not known yet and read as 0. */
+int parseValue(asmType *a, long long *value, symbolType **sym)
+{
+    const char *name;
+    int len;
+
+    *sym = NULL;
+    skipSpace(a);
+    if (a->p < a->end && (isalpha((unsigned char)*a->p) || *a->p == '_' || *a->p == '.')) {
+        parseIdent(a, &name, &len);
+        *value = 0;
+        if (a->pass == 1)
+            return(1);
+        *sym = findSymbol(a, name, len);
+        if ((*sym)->name == NULL) {
+            asmError(a, "undefined label '%.*s'", len, name);
+            return(0);
+        }
+        *value = (*sym)->value;
+        return(1);
+    }
+    if (!parseNumber(a, value)) {
+        asmError(a, "expected a number or label");
+        return(0);
+    }
+    return(1);
+}
 
-        			newState.MEMWB.writeReg = get_rd(newState.MEMWB.instr); 
+/* Parse a 16-bit signed immediate */
+int parseImmed(asmType *a, int *immed, symbolType **sym)
+{
+    long long value;
 
-        			newState.regFile[newState.MEMWB.writeReg] = newState.MEMWB.writeDataALU;
+    if (!parseValue(a, &value, sym))
+        return(0);
+    if (value < -32768 || value > 32767) {
+        asmError(a, "immediate %lld does not fit in 16 bits", value);
+        return(0);
+    }
+    *immed = (int)value;
+    return(1);
+}
 
-        			break;
+/* Append a word to instruction or data memory in pass 2 (pass 1 only counts) */
+void emitWord(asmType *a, int isData, unsigned int word)
+{
+    if (a->pass == 2) {
+        if (isData)
+            a->program->data[a->numData] = (int)word;
+        else
+            a->program->instr[a->numInstr] = word;
+    }
+    if (isData)
+        a->numData++;
+    else
+        a->numInstr++;
+}
 
-        		} else {
+/* Assemble the line between a->p and a->end */
+void assembleLine(asmType *a)
+{
+    const char *name, *save;
+    int len, rd, rs, rt, immed;
+    long long value;
+    symbolType *sym;
+
+    /* Labels */
+    for (;;) {
+        save = a->p;
+        if (!parseIdent(a, &name, &len) || name[0] == '.')
+            break;
+        skipSpace(a);
+        if (a->p == a->end || *a->p != ':')
+            break;
+        a->p++;
+        if (a->pass == 1)
+            defineLabel(a, name, len);
+    }
+    a->p = save;
+    if (atLineEnd(a))
+        return;
+    if (!parseIdent(a, &name, &len)) {
+        asmError(a, "expected a label, instruction or directive");
+        return;
+    }
 
-        			newState.MEMWB.writeDataALU = 0;
+#define IS(word) (len == (int)strlen(word) && strncmp(name, word, len) == 0)
+    if (name[0] == '.')
+        bindLabels(a, 1);
+    else
+        bindLabels(a, 0);
+
+    if (IS(".word") || IS(".fill")) {
+        do {
+            if (!parseValue(a, &value, &sym))
+                return;
+            if (value < -0x80000000LL || value > 0xFFFFFFFFLL) {
+                asmError(a, "value %lld does not fit in 32 bits", value);
+                return;
+            }
+            emitWord(a, 1, (unsigned int)value);
+            skipSpace(a);
+        } while (a->p < a->end && *a->p == ',' && a->p++);
+    } else if (IS(".space")) {
+        if (!parseNumber(a, &value) || value < 0 || value > 0x7FFFFFFFLL) {
+            asmError(a, "expected a size in bytes");
+            return;
+        }
+        for (value = (value + 3) / 4; value > 0; value--)
+            emitWord(a, 1, 0);
+    } else if (IS("add") || IS("sub")) {
+        if (!parseReg(a, &rd) || !expectChar(a, ',') || !parseReg(a, &rs)
+            || !expectChar(a, ',') || !parseReg(a, &rt))
+            return;
+        emitWord(a, 0, (R << 26) | (rs << 21) | (rt << 16) | (rd << 11) | (IS("add") ? ADD : SUB));
+    } else if (IS("lw") || IS("sw")) {
+        if (!parseReg(a, &rt) || !expectChar(a, ',') || !parseImmed(a, &immed, &sym)
+            || !expectChar(a, '(') || !parseReg(a, &rs) || !expectChar(a, ')'))
+            return;
+        emitWord(a, 0, ((unsigned int)(IS("lw") ? LW : SW) << 26) | (rs << 21) | (rt << 16) | (immed & 0xFFFF));
+    } else if (IS("bne")) {
+        if (!parseReg(a, &rs) || !expectChar(a, ',') || !parseReg(a, &rt) || !expectChar(a, ','))
+            return;
+        if (!parseValue(a, &value, &sym))
+            return;
+        if (sym != NULL) {
+            if (sym->isData) {
+                asmError(a, "branch target '%.*s' is a data label", sym->len, sym->name);
+                return;
+            }
+            value = (value - 4 * (a->numInstr + 1)) / 4;
+        }
+        if (value < -32768 || value > 32767) {
+            asmError(a, "branch offset %lld does not fit in 16 bits", value);
+            return;
+        }
+        emitWord(a, 0, ((unsigned int)BNE << 26) | (rs << 21) | (rt << 16) | ((int)value & 0xFFFF));
+    } else if (IS("halt") || IS("noop")) {
+        emitWord(a, 0, IS("halt") ? (unsigned int)HALT << 26 : 0);
+        return;
+    } else {
+        asmError(a, "unknown instruction or directive '%.*s'", len, name);
+        return;
+    }
+#undef IS
 
-        			newState.MEMWB.writeReg = 0;
+    if (!atLineEnd(a))
+        asmError(a, "unexpected text after operands");
+}
 
-        			break;
+/* Run one pass over the whole text */
+void assemblePass(asmType *a, const char *text, size_t size)
+{
+    const char *line = text, *end = text + size, *eol;
+
+    a->numInstr = a->numData = 0;
+    for (a->line = 1; line < end; a->line++, line = eol + 1) {
+        eol = memchr(line, '\n', end - line);
+        if (eol == NULL)
+            eol = end;
+        a->p = line;
+        a->end = eol;
+        assembleLine(a);
+    }
+}
 
-        		}      		
+/******************************************************************/
+/* The loadProgram function assembles a program from a file,      */
+/* collecting the instructions, the initial data memory contents  */
+/* and the labels. A binary image written by saveImage is loaded  */
+/* as it is instead. name is used in error messages. Returns      */
+/* nonzero, after reporting errors on stderr, on failure.         */
+/******************************************************************/
+int loadProgram(FILE *in, const char *name, programType *program)
+{
+    asmType a;
+    struct stat st;
+    char *text = NULL;
+    size_t size = 0, cap = 0, n;
+    int mapped = 0;
+    int i, j;
+    char *names;
+
+    memset(program, 0, sizeof(*program));
+    if (fstat(fileno(in), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0
+        && ftello(in) == 0) {
+        text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(in), 0);
+        mapped = (text != MAP_FAILED);
+        size = mapped ? (size_t)st.st_size : 0;
+    }
+    if (!mapped) {
+        text = NULL;
+        do {
+            if (size == cap) {
+                cap = cap ? 2 * cap : 65536;
+                text = realloc(text, cap);
+            }
+            n = fread(text + size, 1, cap - size, in);
+            size += n;
+        } while (n > 0);
+    }
+    if (size >= sizeof(imageType) && memcmp(text, IMAGEMAGIC, 8) == 0)
+        return(loadImage(text, size, mapped ? dup(fileno(in)) : -1, name, program));
+
+    memset(&a, 0, sizeof(a));
+    a.name = name;
+    a.program = program;
+    a.symMask = 63;
+    a.symbols = calloc(a.symMask + 1, sizeof(symbolType));
+    a.pass = 1;
+    assemblePass(&a, text, size);
+    bindLabels(&a, 0);
+    if (a.errors == 0) {
+        program->numInstr = a.numInstr;
+        program->numData = a.numData;
+        program->instr = malloc(4 * (size_t)a.numInstr + 1);
+        program->data = malloc(4 * (size_t)a.numData + 1);
+        a.pass = 2;
+        assemblePass(&a, text, size);
+    }
 
+    /* Keep the labels, with their names copied out of the text */
+    if (a.errors == 0 && a.numSymbols > 0) {
+        size_t namesSize = 0;
+        for (i = 0; i <= a.symMask; i++)
+            namesSize += a.symbols[i].name ? a.symbols[i].len + 1 : 0;
+        program->labels = malloc(sizeof(labelType) * a.numSymbols);
+        program->labelNames = names = malloc(namesSize);
+        for (i = j = 0; i <= a.symMask; i++) {
+            if (a.symbols[i].name == NULL)
+                continue;
+            memcpy(names, a.symbols[i].name, a.symbols[i].len);
+            names[a.symbols[i].len] = '\0';
+            program->labels[j].name = (int)(names - program->labelNames);
+            program->labels[j].value = a.symbols[i].value;
+            program->labels[j].isData = a.symbols[i].isData;
+            names += a.symbols[i].len + 1;
+            j++;
         }
+        program->numLabels = j;
+        program->labelNamesSize = (int)namesSize;
+    }
 
+    if (mapped)
+        munmap(text, size);
+    else
+        free(text);
+    free(a.symbols);
+    free(a.pending);
+    if (a.errors > 0) {
+        if (a.errors > 20)
+            fprintf(stderr, "%s: %d errors\n", name, a.errors);
+        freeProgram(program);
+        return(1);
+    }
+    return(0);
+}
 
+/******************************************************************/
+/* The loadImage function takes over the size bytes of a binary   */
+/* image at image, either mapped from fd or read into a malloc'd  */
+/* buffer (fd is -1), and points program at the instructions,     */
+/* data and labels inside it. Nothing is copied; initState maps   */
+/* the memories from fd. Returns nonzero on a malformed image,    */
+/* including decoded instructions that do not match the encoded   */
+/* ones, as the pipeline trusts their register numbers.           */
+/******************************************************************/
+int loadImage(char *image, size_t size, int fd, const char *name, programType *program)
+{
+    imageType *header = (imageType*)image;
+    labelType *labels;
+    decodedType *decoded, dec;
+    int i, bad = 0;
+
+    program->image = header;
+    program->imageSize = size;
+    program->imageFd = fd;
+    if (header->version != IMAGEVERSION || header->decodedSize != sizeof(decodedType) || header->numInstr < 0 || header->numData < 0
+        || header->numLabels < 0 || header->labelNamesSize < 0
+        || header->labelsOffset < (long long)sizeof(imageType) || header->labelsOffset % sizeof(int) != 0
+        || header->labelNamesOffset < (long long)sizeof(imageType)
+        || header->instrOffset < 0 || header->instrOffset % CKPTALIGN != 0
+        || header->dataOffset < 0 || header->dataOffset % CKPTALIGN != 0
+        || header->decodedOffset < 0 || header->decodedOffset % CKPTALIGN != 0
+        || header->labelsOffset + (long long)sizeof(labelType) * header->numLabels > (long long)size
+        || header->labelNamesOffset + header->labelNamesSize > (long long)size
+        || header->instrOffset + 4LL * header->numInstr > (long long)size
+        || header->dataOffset + 4LL * header->numData > (long long)size
+        || header->decodedOffset + (long long)sizeof(decodedType) * (header->numInstr + 1) > (long long)size
+        || (header->labelNamesSize > 0 && image[header->labelNamesOffset + header->labelNamesSize - 1] != '\0')) {
+        bad = 1;
+    } else {
+        /* The NOOP at NOOPINDEX, then each instruction as decodeInstr decodes it */
+        labels = (labelType*)(image + header->labelsOffset);
+        decoded = (decodedType*)(image + header->decodedOffset);
+        memset(&dec, 0, sizeof(dec));
+        bad = memcmp(&decoded[NOOPINDEX], &dec, sizeof(dec)) != 0;
+        for (i = 0; i < header->numInstr && !bad; i++) {
+            decodeInstr(((unsigned int*)(image + header->instrOffset))[i], &dec);
+            bad = memcmp(&decoded[DECODEDINDEX(4 * i)], &dec, sizeof(dec)) != 0;
+        }
+        for (i = 0; i < header->numLabels && !bad; i++)
+            bad = labels[i].name < 0 || labels[i].name >= header->labelNamesSize;
+    }
+    if (bad) {
+        fprintf(stderr, "%s: error: not a version %d program image from this simulator\n", name, IMAGEVERSION);
+        freeProgram(program);
+        return(1);
+    }
+    program->instr = (unsigned int*)(image + header->instrOffset);
+    program->numInstr = header->numInstr;
+    program->data = (int*)(image + header->dataOffset);
+    program->numData = header->numData;
+    program->labels = (labelType*)(image + header->labelsOffset);
+    program->numLabels = header->numLabels;
+    program->labelNames = image + header->labelNamesOffset;
+    program->labelNamesSize = header->labelNamesSize;
+    return(0);
+}
 
-        state = newState;    /* The newState now becomes the old state before we execute the next cycle */
-  
-    	}
+/******************************************************************/
+/* The saveImage function writes an assembled program to a binary */
+/* image: an imageType header, the labels and their names, then   */
+/* the instructions, the initial data and the decoded             */
+/* instructions at CKPTALIGN-aligned offsets so that they can be  */
+/* mapped straight into simulator memory. Returns nonzero on      */
+/* failure.                                                       */
+/******************************************************************/
+int saveImage(programType *program, char *file)
+{
+    imageType header;
+    decodedType *decoded;
+    FILE *out;
+    int i, ok;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, IMAGEMAGIC, sizeof(header.magic));
+    header.version = IMAGEVERSION;
+    header.decodedSize = sizeof(decodedType);
+    header.numInstr = program->numInstr;
+    header.numData = program->numData;
+    header.numLabels = program->numLabels;
+    header.labelNamesSize = program->labelNamesSize;
+    header.labelsOffset = sizeof(header);
+    header.labelNamesOffset = header.labelsOffset + (long long)sizeof(labelType) * program->numLabels;
+    header.instrOffset = (header.labelNamesOffset + program->labelNamesSize + CKPTALIGN - 1) / CKPTALIGN * CKPTALIGN;
+    header.dataOffset = (header.instrOffset + 4LL * program->numInstr + CKPTALIGN - 1) / CKPTALIGN * CKPTALIGN;
+    header.decodedOffset = (header.dataOffset + 4LL * program->numData + CKPTALIGN - 1) / CKPTALIGN * CKPTALIGN;
+
+    decoded = calloc((size_t)program->numInstr + 1, sizeof(decodedType));
+    for (i = 0; i < program->numInstr; i++)
+        decodeInstr(program->instr[i], &decoded[DECODEDINDEX(4 * i)]);
+
+    if ((out = fopen(file, "wb")) == NULL) {
+        free(decoded);
+        return(1);
+    }
+    ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    if (ok && program->numLabels > 0)
+        ok = fwrite(program->labels, sizeof(labelType) * program->numLabels, 1, out) == 1
+            && fwrite(program->labelNames, program->labelNamesSize, 1, out) == 1;
+    if (ok && program->numInstr > 0)
+        ok = fseeko(out, header.instrOffset, SEEK_SET) == 0
+            && fwrite(program->instr, 4 * (size_t)program->numInstr, 1, out) == 1;
+    if (ok && program->numData > 0)
+        ok = fseeko(out, header.dataOffset, SEEK_SET) == 0
+            && fwrite(program->data, 4 * (size_t)program->numData, 1, out) == 1;
+    if (ok)
+        ok = fseeko(out, header.decodedOffset, SEEK_SET) == 0
+            && fwrite(decoded, sizeof(decodedType) * ((size_t)program->numInstr + 1), 1, out) == 1;
+    if (fclose(out) != 0)
+        ok = 0;
+    free(decoded);
+    return(!ok);
+}
 
+void freeProgram(programType *program)
+{
+    if (program->image != NULL && program->imageFd >= 0) {
+        munmap(program->image, program->imageSize);
+        close(program->imageFd);
+    } else if (program->image != NULL) {
+        free(program->image);
+    } else {
+        free(program->instr);
+        free(program->data);
+        free(program->labels);
+        free(program->labelNames);
+    }
+    memset(program, 0, sizeof(*program));
 }
 
 /******************************************************************/
@@ -471,68 +6771,99 @@ void run(){
 /* state as an argument, initializing the state to pre-execution  */
 /* state. In particular, all registers are zero'd out. All        */
 /* instructions in the pipeline are NOOPS. Data and instruction   */
-/* memory are initialized with the contents of the assembly       */
-/* input file.                                                    */
+/* memory are initialized with the contents of the program, and   */
+/* are sized to the larger of the program and the sizes given in  */
+/* the configuration (at least NUMMEMORY words). Returns nonzero  */
+/* if the memories cannot be allocated.                           */
 /*****************************************************************/
-void initState(stateType *statePtr)
+int initState(stateType *statePtr, configType *config, programType *program)
 {
-    unsigned int dec_inst;
-    int data_index = 0;
-    int inst_index = 0;
-    char line[130];
-    char instr[5];
-    char args[130];
-    char* arg; 
+    int i;
 
     statePtr->PC = 0;
     statePtr->cycles = 0;
+    statePtr->fault = 0;
+    statePtr->width = config->ooo ? 0 : config->width;
+    statePtr->nextId = 1;
+    statePtr->blocks = NULL;
 
-    /* Zero out data, instructions, and registers */
-    memset(statePtr->dataMem, 0, 4*NUMMEMORY);
-    memset(statePtr->instrMem, 0, 4*NUMMEMORY);
+    /* Zero out registers */
     memset(statePtr->regFile, 0, 4*NUMREGS);
 
-    /* Parse assembly file and initialize data/instruction memory */
-    while(fgets(line, 130, stdin)){
-        if(sscanf(line, "\t.%s %s", instr, args) == 2){
-            arg = strtok(args, ",");
-            while(arg != NULL){
-                statePtr->dataMem[data_index] = atoi(arg);
-                data_index += 1;
-                arg = strtok(NULL, ","); 
-            }  
+    /* Allocate zeroed memories and copy the program into them */
+    statePtr->numInstrMem = program->numInstr > config->instrWords ? program->numInstr : config->instrWords;
+    if (statePtr->numInstrMem < NUMMEMORY)
+        statePtr->numInstrMem = NUMMEMORY;
+    statePtr->numDataMem = program->numData > config->dataWords ? program->numData : config->dataWords;
+    if (statePtr->numDataMem < NUMMEMORY)
+        statePtr->numDataMem = NUMMEMORY;
+    if (program->image != NULL && program->imageFd >= 0) {
+        /* Map a binary image straight in, decoded instructions included */
+        statePtr->instrMem = mapImage(program->imageFd, program->image->instrOffset,
+            4 * (size_t)program->numInstr, 4 * (size_t)statePtr->numInstrMem);
+        statePtr->dataMem = mapImage(program->imageFd, program->image->dataOffset,
+            4 * (size_t)program->numData, 4 * (size_t)statePtr->numDataMem);
+        statePtr->decodedMem = mapImage(program->imageFd, program->image->decodedOffset,
+            sizeof(decodedType) * ((size_t)program->numInstr + 1),
+            sizeof(decodedType) * ((size_t)statePtr->numInstrMem + 2));
+        if (statePtr->instrMem == NULL || statePtr->dataMem == NULL || statePtr->decodedMem == NULL) {
+            freeState(statePtr);
+            return(1);
         }
-        else if(sscanf(line, "\t%s %s", instr, args) == 2){
-            dec_inst = instrToInt(instr, args);
-            statePtr->instrMem[inst_index] = dec_inst;
-            inst_index += 1;
+    } else {
+        statePtr->instrMem = allocMemory(4 * (size_t)statePtr->numInstrMem);
+        statePtr->dataMem = allocMemory(4 * (size_t)statePtr->numDataMem);
+        statePtr->decodedMem = allocMemory(sizeof(decodedType) * ((size_t)statePtr->numInstrMem + 2));
+        if (statePtr->instrMem == NULL || statePtr->dataMem == NULL || statePtr->decodedMem == NULL) {
+            freeState(statePtr);
+            return(1);
         }
-    } 
+        if (program->numInstr > 0)
+            memcpy(statePtr->instrMem, program->instr, 4 * (size_t)program->numInstr);
+        if (program->numData > 0)
+            memcpy(statePtr->dataMem, program->data, 4 * (size_t)program->numData);
+
+        /* Decode the program once; the rest of decodedMem is zeroed, i.e. NOOPs */
+        for (i = 0; i < program->numInstr; i++)
+            decodeInstr(statePtr->instrMem[i], &statePtr->decodedMem[DECODEDINDEX(4 * i)]);
+    }
+    decodeInstr((unsigned int)HALT << 26, &statePtr->decodedMem[ENDINDEX(statePtr)]);
 
     /* Zero-out all registers in pipeline to start */
-    statePtr->IFID.instr = 0;
-    statePtr->IFID.PCPlus4 = 0;
-    statePtr->IDEX.instr = 0;
-    statePtr->IDEX.PCPlus4 = 0;
-    statePtr->IDEX.branchTarget = 0;
-    statePtr->IDEX.readData1 = 0;
-    statePtr->IDEX.readData2 = 0;
-    statePtr->IDEX.immed = 0;
-    statePtr->IDEX.rsReg = 0;
-    statePtr->IDEX.rtReg = 0;
-    statePtr->IDEX.rdReg = 0;
- 
-    statePtr->EXMEM.instr = 0;
-    statePtr->EXMEM.aluResult = 0;
-    statePtr->EXMEM.writeDataReg = 0;
-    statePtr->EXMEM.writeReg = 0;
-
-    statePtr->MEMWB.instr = 0;
-    statePtr->MEMWB.writeDataMem = 0;
-    statePtr->MEMWB.writeDataALU = 0;
-    statePtr->MEMWB.writeReg = 0;
+    resetPipeline(statePtr);
+    return(0);
+ }
+
+/*************************************************************/
+/* The resetPipeline function fills the pipeline registers   */
+/* with NOOPs, e.g. before the pipeline model takes over     */
+/* from the functional engine.                               */
+/*************************************************************/
+void resetPipeline(stateType *statePtr)
+{
+    statePtr->cur = 0;
+    statePtr->memStall = 0;
+    statePtr->memDone = 0;
+    statePtr->fetchStall = 0;
+    statePtr->fetchDone = 0;
+    memset(statePtr->pipe, 0, sizeof(statePtr->pipe));
  }
 
+/*************************************************************/
+/* The freeState function releases the memories allocated    */
+/* by initState.                                             */
+/*************************************************************/
+void freeState(stateType *statePtr)
+{
+    freeBlocks(statePtr);
+    freeMemory(statePtr->instrMem, 4 * (size_t)statePtr->numInstrMem);
+    freeMemory(statePtr->dataMem, 4 * (size_t)statePtr->numDataMem);
+    freeMemory(statePtr->decodedMem, sizeof(decodedType) * ((size_t)statePtr->numInstrMem + 2));
+    statePtr->instrMem = NULL;
+    statePtr->dataMem = NULL;
+    statePtr->decodedMem = NULL;
+}
+
 
  /***************************************************************************************/
  /*              You do not need to modify the functions below.                         */
@@ -548,8 +6879,9 @@ void initState(stateType *statePtr)
 /*************************************************************/
 void printState(stateType *statePtr)
 {
-    int i;
-    printf("\n********************\nState at the beginning of cycle %d:\n", statePtr->cycles+1);
+    int i, w;
+    pipeType *pipe = &statePtr->pipe[statePtr->cur];
+    printf("\n********************\nState at the beginning of cycle %lld:\n", statePtr->cycles+1);
     printf("\tPC = %d\n", statePtr->PC);
     printf("\tData Memory:\n");
     for (i=0; i<(NUMMEMORY/2); i++) {
@@ -561,86 +6893,55 @@ void printState(stateType *statePtr)
         printf("\t\tregFile[%d] = %d\t\tregFile[%d] = %d\n", 
             i, statePtr->regFile[i], i+(NUMREGS/2), statePtr->regFile[i+(NUMREGS/2)]);
     }
-    printf("\tIF/ID:\n");
-    printf("\t\tInstruction: ");
-    printInstruction(statePtr->IFID.instr);
-    printf("\t\tPCPlus4: %d\n", statePtr->IFID.PCPlus4);
-    printf("\tID/EX:\n");
-    printf("\t\tInstruction: ");
-    printInstruction(statePtr->IDEX.instr);
-    printf("\t\tPCPlus4: %d\n", statePtr->IDEX.PCPlus4);
-    printf("\t\tbranchTarget: %d\n", statePtr->IDEX.branchTarget);
-    printf("\t\treadData1: %d\n", statePtr->IDEX.readData1);
-    printf("\t\treadData2: %d\n", statePtr->IDEX.readData2);
-    printf("\t\timmed: %d\n", statePtr->IDEX.immed);
-    printf("\t\trs: %d\n", statePtr->IDEX.rsReg);
-    printf("\t\trt: %d\n", statePtr->IDEX.rtReg);
-    printf("\t\trd: %d\n", statePtr->IDEX.rdReg);
-    printf("\tEX/MEM:\n");
-    printf("\t\tInstruction: ");
-    printInstruction(statePtr->EXMEM.instr);
-    printf("\t\taluResult: %d\n", statePtr->EXMEM.aluResult);
-    printf("\t\twriteDataReg: %d\n", statePtr->EXMEM.writeDataReg);
-    printf("\t\twriteReg:%d\n", statePtr->EXMEM.writeReg);
-    printf("\tMEM/WB:\n");
-    printf("\t\tInstruction: ");
-    printInstruction(statePtr->MEMWB.instr);
-    printf("\t\twriteDataMem: %d\n", statePtr->MEMWB.writeDataMem);
-    printf("\t\twriteDataALU: %d\n", statePtr->MEMWB.writeDataALU);
-    printf("\t\twriteReg: %d\n", statePtr->MEMWB.writeReg);
-}
-
-/*************************************************************/
-/*  The instrToInt function converts an instruction from the */
-/*  assembly file into an unsigned integer representation.   */
-/*  For example, consider the add $0,$1,$2 instruction.      */
-/*  In binary, this instruction is:                          */
-/*   000000 00001 00010 00000 00000 100000                   */
-/*  The unsigned representation in decimal is therefore:     */
-/*   2228256                                                 */
-/*************************************************************/
-unsigned int instrToInt(char* inst, char* args){
-
-    int opcode, rs, rt, rd, shamt, funct, immed;
-    unsigned int dec_inst;
-    
-    if((strcmp(inst, "add") == 0) || (strcmp(inst, "sub") == 0)){
-        opcode = 0;
-        if(strcmp(inst, "add") == 0)
-            funct = ADD;
+    for (w = 0; w < statePtr->width; w++) {
+        if (statePtr->width == 1)
+            printf("\tIF/ID:\n");
         else
-            funct = SUB; 
-        shamt = 0; 
-        rd = atoi(strtok(args, ",$"));
-        rs = atoi(strtok(NULL, ",$"));
-        rt = atoi(strtok(NULL, ",$"));
-        dec_inst = (opcode << 26) + (rs << 21) + (rt << 16) + (rd << 11) + (shamt << 6) + funct;
-    } else if((strcmp(inst, "lw") == 0) || (strcmp(inst, "sw") == 0)){
-        if(strcmp(inst, "lw") == 0)
-            opcode = LW;
+            printf("\tIF/ID slot %d:\n", w);
+        printf("\t\tInstruction: ");
+        printInstruction(statePtr->decodedMem[pipe->IFID[w].instr].instr);
+        printf("\t\tPCPlus4: %d\n", pipe->IFID[w].PCPlus4);
+    }
+    for (w = 0; w < statePtr->width; w++) {
+        if (statePtr->width == 1)
+            printf("\tID/EX:\n");
+        else
+            printf("\tID/EX slot %d:\n", w);
+        printf("\t\tInstruction: ");
+        printInstruction(statePtr->decodedMem[pipe->IDEX[w].instr].instr);
+        printf("\t\tPCPlus4: %d\n", pipe->IDEX[w].PCPlus4);
+        printf("\t\tbranchTarget: %d\n", pipe->IDEX[w].branchTarget);
+        printf("\t\treadData1: %d\n", pipe->IDEX[w].readData1);
+        printf("\t\treadData2: %d\n", pipe->IDEX[w].readData2);
+        printf("\t\timmed: %d\n", pipe->IDEX[w].immed);
+        printf("\t\trs: %d\n", pipe->IDEX[w].rsReg);
+        printf("\t\trt: %d\n", pipe->IDEX[w].rtReg);
+        printf("\t\trd: %d\n", pipe->IDEX[w].rdReg);
+    }
+    for (w = 0; w < statePtr->width; w++) {
+        if (statePtr->width == 1)
+            printf("\tEX/MEM:\n");
+        else
+            printf("\tEX/MEM slot %d:\n", w);
+        printf("\t\tInstruction: ");
+        printInstruction(statePtr->decodedMem[pipe->EXMEM[w].instr].instr);
+        printf("\t\taluResult: %d\n", pipe->EXMEM[w].aluResult);
+        printf("\t\twriteDataReg: %d\n", pipe->EXMEM[w].writeDataReg);
+        printf("\t\twriteReg:%d\n", pipe->EXMEM[w].writeReg);
+    }
+    for (w = 0; w < statePtr->width; w++) {
+        if (statePtr->width == 1)
+            printf("\tMEM/WB:\n");
         else
-            opcode = SW;
-        rt = atoi(strtok(args, ",$"));
-        immed = atoi(strtok(NULL, ",("));
-        rs = atoi(strtok(NULL, "($)"));
-        dec_inst = (opcode << 26) + (rs << 21) + (rt << 16) + immed;
-    } else if(strcmp(inst, "bne") == 0){
-        opcode = 4;
-        rs = atoi(strtok(args, ",$"));
-        rt = atoi(strtok(NULL, ",$"));
-        immed = atoi(strtok(NULL, ","));
-        dec_inst = (opcode << 26) + (rs << 21) + (rt << 16) + immed;   
-    } else if(strcmp(inst, "halt") == 0){
-        opcode = 63; 
-        dec_inst = (opcode << 26);
-    } else if(strcmp(inst, "noop") == 0){
-        dec_inst = 0;
-    }
-    return dec_inst;
+            printf("\tMEM/WB slot %d:\n", w);
+        printf("\t\tInstruction: ");
+        printInstruction(statePtr->decodedMem[pipe->MEMWB[w].instr].instr);
+        printf("\t\twriteDataMem: %d\n", pipe->MEMWB[w].writeDataMem);
+        printf("\t\twriteDataALU: %d\n", pipe->MEMWB[w].writeDataALU);
+        printf("\t\twriteReg: %d\n", pipe->MEMWB[w].writeReg);
+    }
 }
 
-
-
 /*************************************************/
 /*  The printInstruction decodes an unsigned     */
 /*  integer representation of an instruction     */